@@ -34,303 +34,215 @@
 
 #include "EventManager.h"
 
-namespace
-{
-    // This class takes care of turning interrupts on and off.
-    // There is a different implementation of this class for each architecture that
-    // has a different interrupt model.  #if macros ensure only one version is defined.
 
-#if defined( __AVR_ARCH__ )
 
-    class SuppressInterrupts
-    {
-    public:
+EventManagerBase::ListenerList::ListenerList( Delegate* callbacks, ListenerInfo* info, uint8_t* enabled, uint8_t* order, int* codes, int maxListeners ) :
+mCallbacks( callbacks ), mInfo( info ), mEnabled( enabled ), mMaxListeners( maxListeners ), mOrder( order ), mCodes( codes ), mNumListeners( 0 ), mNumCodeListeners( 0 ), mNumRemoved( 0 ), mNumPending( 0 ), mNumSlots( 0 ), mDispatchDepth( 0 ), mDefaultCallback( 0 )
+#if EVENTMANAGER_LISTENER_WATCHDOG
+, mBudgetMicros( 0 ), mOverrunHook( 0 )
+#endif
+{
+#if EVENTMANAGER_DIRECT_DISPATCH
+    updateDirectTable();
+#endif
+}
 
-        // Record the current state and suppress interrupts when the object is instantiated.
-        SuppressInterrupts()
-        {
-            mInterruptsWereOn = (SREG & (1<<SREG_I));
-            cli();
-        }
+int EventManagerBase::ListenerList::numListeners()
+{
+    return mNumListeners + mNumPending - mNumRemoved;
+};
 
-        // Restore whatever interrupt state was active before
-        ~SuppressInterrupts()
-        {
-            // Turn on global interrupts, only if they were already on
-            if ( mInterruptsWereOn )
-            {
-                sei();
-            }
-        }
+EventManagerBase::ListenerHandle EventManagerBase::ListenerList::addListener( int eventCode, const Delegate& listener, int8_t priority )
+{
+    EVTMGR_DEBUG_PRINT( "addListener() enter " )
+    EVTMGR_DEBUG_PRINT( eventCode )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINT_PTR( listener.address() )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINTLN( priority )
 
-    private:
+    return addItem( eventCode, kMatchCode, 0, listener, priority );
+}
 
-        uint8_t     mInterruptsWereOn;
-    };
 
-#elif defined( SAM ) || defined( ARDUINO_ARCH_SAMD )
+EventManagerBase::ListenerHandle EventManagerBase::ListenerList::addRangeListener( int firstCode, int lastCode, const Delegate& listener, int8_t priority )
+{
+    EVTMGR_DEBUG_PRINT( "addRangeListener() enter " )
+    EVTMGR_DEBUG_PRINT( firstCode )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINT( lastCode )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINTLN_PTR( listener.address() )
 
-    class SuppressInterrupts
+    if ( lastCode < firstCode )
     {
-    public:
-
-        // Record the current state and suppress interrupts when the object is instantiated.
-        SuppressInterrupts()
-        {
-            mInterruptsWereOn = (__get_PRIMASK() == 0);
-            __disable_irq();
-        }
-
-        // Restore whatever interrupt state was active before
-        ~SuppressInterrupts()
-        {
-            // Turn on interrupts, only if they were already on
-            if ( mInterruptsWereOn )
-            {
-                __enable_irq();
-            }
-        }
+        return 0;
+    }
 
-    private:
+    return addItem( firstCode, kMatchRange, lastCode, listener, priority );
+}
 
-        uint8_t     mInterruptsWereOn;
-    };
 
-#elif defined( ESP8266 )
+EventManagerBase::ListenerHandle EventManagerBase::ListenerList::addMaskListener( int value, int mask, const Delegate& listener, int8_t priority )
+{
+    EVTMGR_DEBUG_PRINT( "addMaskListener() enter " )
+    EVTMGR_DEBUG_PRINT( value )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINT( mask )
+    EVTMGR_DEBUG_PRINT( ", " )
+    EVTMGR_DEBUG_PRINTLN_PTR( listener.address() )
 
-    class SuppressInterrupts
+    // With bits of value outside the mask, ( code & mask ) == value never holds
+    if ( value & ~mask )
     {
-    public:
+        return 0;
+    }
 
-        // Record the current state and suppress interrupts when the object is instantiated.
-        SuppressInterrupts()
-        {
-            // This turns off interrupts and gets the old state in one function call
-            // See https://github.com/esp8266/Arduino/issues/615 for details
-            // level 15 will disable ALL interrupts,
-            // level 0 will enable ALL interrupts
-            mSavedInterruptState = xt_rsil( 15 );
-        }
+    return addItem( value, kMatchMask, mask, listener, priority );
+}
 
-        // Restore whatever interrupt state was active before
-        ~SuppressInterrupts()
-        {
-            // Restore the old interrupt state
-            xt_wsr_ps( mSavedInterruptState );
-        }
 
-    private:
+EventManagerBase::ListenerHandle EventManagerBase::ListenerList::addItem( int eventCode, uint8_t match, int matchData, const Delegate& listener, int8_t priority )
+{
+    // Argument check
+    if ( !listener.isValid() )
+    {
+        return 0;
+    }
 
-        uint32_t    mSavedInterruptState;
-    };
+    // Check for full dispatch table
+    if ( isFull() )
+    {
+        EVTMGR_DEBUG_PRINTLN( "addListener() list full" )
+        return 0;
+    }
 
-#elif defined( CORE_TEENSY )
-    
-    class SuppressInterrupts
+    // The index is about to be updated anyway, so this is when the tombstones are cleared
+    // (but not during a dispatch, which is still using the index)
+    if ( mNumRemoved && !mDispatchDepth )
     {
-    public:
-        
-        //Reference: https://www.pjrc.com/teensy/interrupts.html
-        //Backup the interrupt enable state and restore it
-        SuppressInterrupts() 
-        {
-            mSregBackup = SREG;     /* save interrupt enable/disable state */
-            cli();                  /* disable the global interrupt */
-        }
-        
-        ~SuppressInterrupts() 
-        {
-            SREG = mSregBackup;     /* restore interrupt state */
-        }
-        
-    private:
-        
-        uint8_t mSregBackup;
-    };
-    
-#elif defined( ESP32 )
-    
-    #include <freertos/portmacro.h>
+        compact();
+    }
 
-    class SuppressInterrupts
+    // Use a slot that has never been used if there is one, otherwise a freed one
+    int slot = mNumSlots;
+    if ( slot < mMaxListeners )
+    {
+        mNumSlots++;
+        mInfo[ slot ].generation = 0;
+    }
+    else
     {
-    public:
-        
-        // Reference: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-guides/freertos-smp.html#critical-sections-disabling-interrupts
-        // Enter critical section
-        SuppressInterrupts()
+        slot = 0;
+        while ( ( slot < mMaxListeners ) && ( mInfo[ slot ].match != kMatchNone ) )
         {
-            portENTER_CRITICAL(&gMux);
+            slot++;
         }
-        
-        // Exit critical section
-        ~SuppressInterrupts()
+        if ( slot == mMaxListeners )
         {
-            portEXIT_CRITICAL(&gMux);
+            // Only possible during a dispatch, when the tombstones can't be cleared yet
+            EVTMGR_DEBUG_PRINTLN( "addListener() no free slot" )
+            return 0;
         }
+    }
 
-        static portMUX_TYPE gMux;
-    };
-    
-    // gMux is globally accessible as a public static member variable
-    portMUX_TYPE SuppressInterrupts::gMux = portMUX_INITIALIZER_UNLOCKED;
-
-#else
-
-#error "Unknown microcontroller:  Need to implement class SuppressInterrupts for this microcontroller."
-
-#endif
-
-}
-
-
-
-
-#if EVENTMANAGER_DEBUG
-#define EVTMGR_DEBUG_PRINT( x )		Serial.print( x );
-#define EVTMGR_DEBUG_PRINTLN( x )	Serial.println( x );
-#define EVTMGR_DEBUG_PRINT_PTR( x )	Serial.print( reinterpret_cast<unsigned long>( x ), HEX );
-#define EVTMGR_DEBUG_PRINTLN_PTR( x )	Serial.println( reinterpret_cast<unsigned long>( x ), HEX );
-#else
-#define EVTMGR_DEBUG_PRINT( x )
-#define EVTMGR_DEBUG_PRINTLN( x )
-#define EVTMGR_DEBUG_PRINT_PTR( x )
-#define EVTMGR_DEBUG_PRINTLN_PTR( x )
+    ListenerInfo& info = mInfo[ slot ];
+    info.matchData = matchData;
+    info.match     = match;
+    info.priority  = priority;
+#if EVENTMANAGER_LISTENER_PROFILING
+    info.profile.calls = 0;
+    info.profile.totalMicros = 0;
+    info.profile.maxMicros = 0;
 #endif
+    mCallbacks[ slot ] = listener;
+    enableSlot( slot, true );
 
-
-EventManager::EventManager()
-{
-}
-
-
-int EventManager::processEvent()
-{
-    int eventCode;
-    int param;
-    int handledCount = 0;
-
-    if ( mHighPriorityQueue.popEvent( &eventCode, &param ) )
+    if ( mDispatchDepth )
     {
-        handledCount = mListeners.sendEvent( eventCode, param );
-
-        EVTMGR_DEBUG_PRINT( "processEvent() hi-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
+        // Added to the index once the dispatch is done (see addPending())
+        mOrder[ mNumListeners + mNumPending ] = slot;
+        mCodes[ mNumListeners + mNumPending ] = eventCode;
+        mNumPending++;
     }
-
-    // If no high-pri events handled (either because there are no high-pri events or
-    // because there are no listeners for them), then try low-pri events
-    if ( !handledCount && mLowPriorityQueue.popEvent( &eventCode, &param ) )
+    else
     {
-        handledCount = mListeners.sendEvent( eventCode, param );
-
-        EVTMGR_DEBUG_PRINT( "processEvent() lo-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
+        insertIntoOrder( slot, eventCode );
     }
 
-    return handledCount;
+    EVTMGR_DEBUG_PRINTLN( "addListener() listener added" )
+
+    return handleOf( slot );
 }
 
 
-int EventManager::processAllEvents()
+void EventManagerBase::ListenerList::insertIntoOrder( int slot, int eventCode )
 {
-    int eventCode;
-    int param;
-    int handledCount = 0;
+    ListenerInfo& info = mInfo[ slot ];
 
-    while ( mHighPriorityQueue.popEvent( &eventCode, &param ) )
+    // Insert it in the index after any other listeners of the same kind (and for the same
+    // event code) that have the same or a higher priority
+    int pos;
+    if ( info.match == kMatchCode )
     {
-        handledCount += mListeners.sendEvent( eventCode, param );
-
-        EVTMGR_DEBUG_PRINT( "processEvent() hi-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
+        pos = firstListener( eventCode );
+        while ( ( pos < mNumCodeListeners ) && ( mCodes[ pos ] == eventCode )
+                && ( mInfo[ mOrder[ pos ] ].priority >= info.priority ) )
+        {
+            pos++;
+        }
+        mNumCodeListeners++;
     }
-
-    while ( mLowPriorityQueue.popEvent( &eventCode, &param ) )
+    else
     {
-        handledCount += mListeners.sendEvent( eventCode, param );
-
-        EVTMGR_DEBUG_PRINT( "processEvent() lo-pri event " )
-        EVTMGR_DEBUG_PRINT( eventCode )
-        EVTMGR_DEBUG_PRINT( ", " )
-        EVTMGR_DEBUG_PRINT( param )
-        EVTMGR_DEBUG_PRINT( " sent to " )
-        EVTMGR_DEBUG_PRINTLN( handledCount )
+        pos = mNumCodeListeners;
+        while ( ( pos < mNumListeners ) && ( mInfo[ mOrder[ pos ] ].priority >= info.priority ) )
+        {
+            pos++;
+        }
     }
+    for ( int i = mNumListeners; i > pos; i-- )
+    {
+        mOrder[ i ] = mOrder[ i - 1 ];
+        mCodes[ i ] = mCodes[ i - 1 ];
+    }
+    mOrder[ pos ] = slot;
+    mCodes[ pos ] = eventCode;
 
-    return handledCount;
-}
-
-
-
-/********************************************************************/
-
-
+    mNumListeners++;
 
-EventManager::ListenerList::ListenerList() :
-mNumListeners( 0 ), mDefaultCallback( 0 )
-{
+#if EVENTMANAGER_DIRECT_DISPATCH
+    updateDirectTable();
+#endif
 }
 
-int EventManager::ListenerList::numListeners()
-{
-    return mNumListeners;
-};
 
-int EventManager::numListeners()
+void EventManagerBase::ListenerList::addPending()
 {
-    return mListeners.numListeners();
-};
-
-boolean EventManager::ListenerList::addListener( int eventCode, EventListener listener )
-{
-    EVTMGR_DEBUG_PRINT( "addListener() enter " )
-    EVTMGR_DEBUG_PRINT( eventCode )
-    EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
-
-    // Argument check
-    if ( !listener )
+    // compact() also drops any pending listeners that were removed again
+    if ( mNumRemoved )
     {
-        return false;
+        compact();
     }
 
-    // Check for full dispatch table
-    if ( isFull() )
+    // Each insertion moves the index up by one over the first pending entry, which it has
+    // just taken, so the rest of the pending list stays intact
+    while ( mNumPending )
     {
-        EVTMGR_DEBUG_PRINTLN( "addListener() list full" )
-        return false;
+        int slot = mOrder[ mNumListeners ];
+        int eventCode = mCodes[ mNumListeners ];
+        mNumPending--;
+        insertIntoOrder( slot, eventCode );
     }
-
-    mListeners[ mNumListeners ].callback = listener;
-    mListeners[ mNumListeners ].eventCode = eventCode;
-    mListeners[ mNumListeners ].enabled 	= true;
-    mNumListeners++;
-
-    EVTMGR_DEBUG_PRINTLN( "addListener() listener added" )
-
-    return true;
 }
 
 
-boolean EventManager::ListenerList::removeListener( int eventCode, EventListener listener )
+boolean EventManagerBase::ListenerList::removeListener( int eventCode, const Delegate& listener )
 {
     EVTMGR_DEBUG_PRINT( "removeListener() enter " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
+    EVTMGR_DEBUG_PRINTLN_PTR( listener.address() )
 
     if ( mNumListeners == 0 )
     {
@@ -345,13 +257,7 @@ boolean EventManager::ListenerList::removeListener( int eventCode, EventListener
         return false;
     }
 
-    for ( int i = k; i < mNumListeners - 1; i++ )
-    {
-        mListeners[ i ].callback  = mListeners[ i + 1 ].callback;
-        mListeners[ i ].eventCode = mListeners[ i + 1 ].eventCode;
-        mListeners[ i ].enabled   = mListeners[ i + 1 ].enabled;
-    }
-    mNumListeners--;
+    removeSlot( k );
 
     EVTMGR_DEBUG_PRINTLN( "removeListener() removed" )
 
@@ -359,10 +265,10 @@ boolean EventManager::ListenerList::removeListener( int eventCode, EventListener
 }
 
 
-int EventManager::ListenerList::removeListener( EventListener listener )
+int EventManagerBase::ListenerList::removeListener( const Delegate& listener )
 {
     EVTMGR_DEBUG_PRINT( "removeListener() enter " )
-    EVTMGR_DEBUG_PRINTLN_PTR( listener )
+    EVTMGR_DEBUG_PRINTLN_PTR( listener.address() )
 
     if ( mNumListeners == 0 )
     {
@@ -370,19 +276,19 @@ int EventManager::ListenerList::removeListener( EventListener listener )
         return 0;
     }
 
+    // A single pass, since removing a listener does not move the others
     int removed = 0;
-    int k;
-    while ((k = searchListeners( listener )) >= 0 )
+    if ( listener.isValid() )
     {
-        for ( int i = k; i < mNumListeners - 1; i++ )
+        for ( int k = 0; k < mNumSlots; k++ )
         {
-            mListeners[ i ].callback  = mListeners[ i + 1 ].callback;
-            mListeners[ i ].eventCode = mListeners[ i + 1 ].eventCode;
-            mListeners[ i ].enabled   = mListeners[ i + 1 ].enabled;
+            if ( mCallbacks[ k ] == listener )
+            {
+                removeSlot( k );
+                removed++;
+            }
         }
-        mNumListeners--;
-        removed++;
-   }
+    }
 
     EVTMGR_DEBUG_PRINT( "  removeListener() removed " )
     EVTMGR_DEBUG_PRINTLN( removed )
@@ -391,12 +297,49 @@ int EventManager::ListenerList::removeListener( EventListener listener )
 }
 
 
-boolean EventManager::ListenerList::enableListener( int eventCode, EventListener listener, boolean enable )
+boolean EventManagerBase::ListenerList::removeListener( ListenerHandle handle )
+{
+    EVTMGR_DEBUG_PRINT( "removeListener() enter handle " )
+    EVTMGR_DEBUG_PRINTLN( handle )
+
+    int k = slotOf( handle );
+    if ( k < 0 )
+    {
+        EVTMGR_DEBUG_PRINTLN( "removeListener() not found" )
+        return false;
+    }
+
+    removeSlot( k );
+    return true;
+}
+
+
+boolean EventManagerBase::ListenerList::enableListener( ListenerHandle handle, boolean enable )
+{
+    int k = slotOf( handle );
+    if ( k < 0 )
+    {
+        return false;
+    }
+
+    enableSlot( k, enable );
+    return true;
+}
+
+
+boolean EventManagerBase::ListenerList::isListenerEnabled( ListenerHandle handle )
+{
+    int k = slotOf( handle );
+    return ( k >= 0 ) && isSlotEnabled( k );
+}
+
+
+boolean EventManagerBase::ListenerList::enableListener( int eventCode, const Delegate& listener, boolean enable )
 {
     EVTMGR_DEBUG_PRINT( "enableListener() enter " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
-    EVTMGR_DEBUG_PRINT_PTR( listener )
+    EVTMGR_DEBUG_PRINT_PTR( listener.address() )
     EVTMGR_DEBUG_PRINT( ", " )
     EVTMGR_DEBUG_PRINTLN( enable )
 
@@ -413,14 +356,14 @@ boolean EventManager::ListenerList::enableListener( int eventCode, EventListener
         return false;
     }
 
-    mListeners[ k ].enabled = enable;
+    enableSlot( k, enable );
 
     EVTMGR_DEBUG_PRINTLN( "enableListener() success" )
     return true;
 }
 
 
-boolean EventManager::ListenerList::isListenerEnabled( int eventCode, EventListener listener )
+boolean EventManagerBase::ListenerList::isListenerEnabled( int eventCode, const Delegate& listener )
 {
     if ( mNumListeners == 0 )
     {
@@ -433,36 +376,83 @@ boolean EventManager::ListenerList::isListenerEnabled( int eventCode, EventListe
         return false;
     }
 
-    return mListeners[ k ].enabled;
+    return isSlotEnabled( k );
 }
 
 
-int EventManager::ListenerList::sendEvent( int eventCode, int param )
+int EventManagerBase::ListenerList::sendEvent( int eventCode, int param, boolean alreadyHandled )
 {
     EVTMGR_DEBUG_PRINT( "sendEvent() enter " )
     EVTMGR_DEBUG_PRINT( eventCode )
     EVTMGR_DEBUG_PRINT( ", " )
     EVTMGR_DEBUG_PRINTLN( param )
 
+    // Listeners may add or remove listeners while the index is being walked:  removed
+    // listeners become tombstones, which don't move anything, and added ones wait in the
+    // pending list until the outermost dispatch is done
+    mDispatchDepth++;
+
+    // Only the run of listeners for this event code in the index needs to be looked at,
+    // merged by priority with the range and pattern listeners that match it, and only
+    // until one of them consumes the event
     int handlerCount = 0;
-    for ( int i = 0; i < mNumListeners; i++ )
+    int i = firstListener( eventCode );
+    int w = mNumCodeListeners;
+    for ( ;; )
     {
-        if ( ( mListeners[ i ].callback != 0 ) && ( mListeners[ i ].eventCode == eventCode ) && mListeners[ i ].enabled )
+        while ( ( w < mNumListeners ) && !matches( w, eventCode ) )
+        {
+            w++;
+        }
+        boolean haveCode = ( i < mNumCodeListeners ) && ( mCodes[ i ] == eventCode );
+        if ( !haveCode && ( w == mNumListeners ) )
+        {
+            break;
+        }
+
+        int k;
+        if ( haveCode && ( ( w == mNumListeners ) || ( mInfo[ mOrder[ i ] ].priority >= mInfo[ mOrder[ w ] ].priority ) ) )
+        {
+            k = mOrder[ i++ ];
+        }
+        else
+        {
+            k = mOrder[ w++ ];
+        }
+
+        if ( mCallbacks[ k ].isValid() && isSlotEnabled( k ) )
         {
             handlerCount++;
-            (*mListeners[ i ].callback)( eventCode, param );
+#if EVENTMANAGER_TIME_LISTENERS
+            unsigned long start = micros();
+            boolean consumed = mCallbacks[ k ]( eventCode, param );
+            listenerTimed( k, eventCode, micros() - start );
+#else
+            boolean consumed = mCallbacks[ k ]( eventCode, param );
+#endif
+            if ( consumed )
+            {
+                EVTMGR_DEBUG_PRINTLN( "sendEvent() consumed" )
+                break;
+            }
         }
     }
 
     EVTMGR_DEBUG_PRINT( "sendEvent() sent to " )
     EVTMGR_DEBUG_PRINTLN( handlerCount )
 
-    if ( !handlerCount )
+    if ( !handlerCount && !alreadyHandled )
     {
         if ( ( mDefaultCallback != 0 ) && mDefaultCallbackEnabled )
         {
             handlerCount++;
+#if EVENTMANAGER_LISTENER_WATCHDOG
+            unsigned long start = micros();
+            (*mDefaultCallback)( eventCode, param );
+            listenerTimed( -1, eventCode, micros() - start );
+#else
             (*mDefaultCallback)( eventCode, param );
+#endif
 
             EVTMGR_DEBUG_PRINTLN( "sendEvent() event sent to default" )
         }
@@ -476,11 +466,17 @@ int EventManager::ListenerList::sendEvent( int eventCode, int param )
 
     }
 
+    mDispatchDepth--;
+    if ( !mDispatchDepth && mNumPending )
+    {
+        addPending();
+    }
+
     return handlerCount;
 }
 
 
-boolean EventManager::ListenerList::setDefaultListener( EventListener listener )
+boolean EventManagerBase::ListenerList::setDefaultListener( EventListener listener )
 {
     EVTMGR_DEBUG_PRINT( "setDefaultListener() enter " )
     EVTMGR_DEBUG_PRINTLN_PTR( listener )
@@ -496,29 +492,43 @@ boolean EventManager::ListenerList::setDefaultListener( EventListener listener )
 }
 
 
-void EventManager::ListenerList::removeDefaultListener()
+void EventManagerBase::ListenerList::removeDefaultListener()
 {
     mDefaultCallback = 0;
     mDefaultCallbackEnabled = false;
 }
 
 
-void EventManager::ListenerList::enableDefaultListener( boolean enable )
+void EventManagerBase::ListenerList::enableDefaultListener( boolean enable )
 {
     mDefaultCallbackEnabled = enable;
 }
 
 
-int EventManager::ListenerList::searchListeners( int eventCode, EventListener listener )
+int EventManagerBase::ListenerList::searchListeners( int eventCode, const Delegate& listener )
 {
-
-    for ( int i = 0; i < mNumListeners; i++ )
+    // A removed listener's slot holds an empty delegate, which must not match
+    if ( !listener.isValid() )
     {
+        return -1;
+    }
 
+    int end = endListener( eventCode );
+    for ( int i = firstListener( eventCode ); i < end; i++ )
+    {
+        if ( mCallbacks[ mOrder[i] ] == listener )
+        {
+            return mOrder[i];
+        }
+    }
 
-        if ( ( mListeners[i].eventCode == eventCode ) && ( mListeners[i].callback == listener ) )
+    // Listeners added during a dispatch are not in the index yet
+    for ( int i = mNumListeners; i < mNumListeners + mNumPending; i++ )
+    {
+        int slot = mOrder[i];
+        if ( ( mInfo[ slot ].match == kMatchCode ) && ( mCodes[i] == eventCode ) && ( mCallbacks[ slot ] == listener ) )
         {
-            return i;
+            return slot;
         }
     }
 
@@ -526,11 +536,16 @@ int EventManager::ListenerList::searchListeners( int eventCode, EventListener li
 }
 
 
-int EventManager::ListenerList::searchListeners( EventListener listener )
+int EventManagerBase::ListenerList::searchListeners( const Delegate& listener )
 {
-    for ( int i = 0; i < mNumListeners; i++ )
+    if ( !listener.isValid() )
+    {
+        return -1;
+    }
+
+    for ( int i = 0; i < mNumSlots; i++ )
     {
-        if ( mListeners[i].callback == listener )
+        if ( mCallbacks[i] == listener )
         {
             return i;
         }
@@ -540,129 +555,685 @@ int EventManager::ListenerList::searchListeners( EventListener listener )
 }
 
 
-int EventManager::ListenerList::searchEventCode( int eventCode )
+int EventManagerBase::ListenerList::searchEventCode( int eventCode )
+{
+    int i = firstListener( eventCode );
+    if ( ( i < mNumCodeListeners ) && ( mCodes[i] == eventCode ) )
+    {
+        return mOrder[i];
+    }
+
+    return -1;
+}
+
+
+int EventManagerBase::ListenerList::firstListener( int eventCode )
 {
-    for ( int i = 0; i < mNumListeners; i++ )
+#if EVENTMANAGER_DIRECT_DISPATCH
+    // Unsigned arithmetic, so codes below the range wrap around to large offsets
+    unsigned int offset = static_cast<unsigned int>( eventCode ) - static_cast<unsigned int>( kFirstDirectCode );
+    if ( offset < static_cast<unsigned int>( kNumDirectCodes ) )
     {
-        if ( mListeners[i].eventCode == eventCode )
+        return mDirect[ offset ];
+    }
+#endif
+
+    // Binary search for the first listener whose code is not less than eventCode
+    int lo = 0;
+    int hi = mNumCodeListeners;
+    while ( lo < hi )
+    {
+        int mid = ( lo + hi ) / 2;
+        if ( mCodes[ mid ] < eventCode )
         {
-            return i;
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
         }
     }
 
-    return -1;
+    return lo;
 }
 
 
+int EventManagerBase::ListenerList::endListener( int eventCode )
+{
+    // Binary search for the first listener whose code is greater than eventCode
+    int lo = 0;
+    int hi = mNumCodeListeners;
+    while ( lo < hi )
+    {
+        int mid = ( lo + hi ) / 2;
+        if ( mCodes[ mid ] <= eventCode )
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
 
-/******************************************************************************/
+#if EVENTMANAGER_DIRECT_DISPATCH
 
+void EventManagerBase::ListenerList::updateDirectTable()
+{
+    // One pass over the index:  pos advances to the first listener for each code in turn
+    int pos = 0;
+    for ( int i = 0; i < kNumDirectCodes; i++ )
+    {
+        while ( ( pos < mNumCodeListeners ) && ( mCodes[ pos ] < kFirstDirectCode + i ) )
+        {
+            pos++;
+        }
+        mDirect[ i ] = pos;
+    }
+}
 
+#endif
 
 
-EventManager::EventQueue::EventQueue() :
-mEventQueueHead( 0 ),
-mEventQueueTail( 0 ),
-mNumEvents( 0 )
+void EventManagerBase::ListenerList::removeSlot( int k )
 {
-    for ( int i = 0; i < kEventQueueSize; i++ )
+    // Leave the entry in the index with no callback, so sendEvent() skips it, and change the
+    // generation so that the listener's handle no longer matches
+    if ( !mCallbacks[ k ].isValid() )
     {
-        mEventQueue[i].code = EventManager::kEventNone;
-        mEventQueue[i].param = 0;
+        // Already a tombstone
+        return;
     }
+    mCallbacks[ k ] = Delegate();
+    mInfo[ k ].generation++;
+    mNumRemoved++;
 }
 
 
+void EventManagerBase::ListenerList::compact()
+{
+    // The pending listeners follow the index in mOrder, and are compacted along with it
+    int j = 0;
+    int numCodeListeners = 0;
+    int numListeners = 0;
+    for ( int i = 0; i < mNumListeners + mNumPending; i++ )
+    {
+        int slot = mOrder[i];
+        if ( mCallbacks[ slot ].isValid() )
+        {
+            if ( i < mNumCodeListeners )
+            {
+                numCodeListeners++;
+            }
+            if ( i < mNumListeners )
+            {
+                numListeners++;
+            }
+            mOrder[ j ] = slot;
+            mCodes[ j ] = mCodes[i];
+            j++;
+        }
+        else
+        {
+            mInfo[ slot ].match = kMatchNone;
+        }
+    }
+    mNumListeners = numListeners;
+    mNumCodeListeners = numCodeListeners;
+    mNumPending = j - numListeners;
+    mNumRemoved = 0;
 
-boolean ISR_ATTR EventManager::EventQueue::queueEvent( int eventCode, int eventParam )
+#if EVENTMANAGER_DIRECT_DISPATCH
+    updateDirectTable();
+#endif
+}
+
+
+int EventManagerBase::ListenerList::slotOf( ListenerHandle handle )
 {
-    /*
-    * The call to noInterrupts() MUST come BEFORE the full queue check.
-    *
-    * If the call to isFull() returns FALSE but an asynchronous interrupt queues
-    * an event, making the queue full, before we finish inserting here, we will then
-    * corrupt the queue (we'll add an event to an already full queue). So the entire
-    * operation, from the call to isFull() to completing the inserting (if not full)
-    * must be atomic.
-    *
-    * Note that this race condition can only arise IF both interrupt and non-interrupt (normal)
-    * code add events to the queue.  If only normal code adds events, this can't happen
-    * because then there are no asynchronous additions to the queue.  If only interrupt
-    * handlers add events to the queue, this can't happen because further interrupts are
-    * blocked while an interrupt handler is executing.  This race condition can only happen
-    * when an event is added to the queue by normal (non-interrupt) code and simultaneously
-    * an interrupt handler tries to add an event to the queue.  This is the case that the
-    * cli() (= noInterrupts()) call protects against.
-    *
-    * Contrast this with the logic in popEvent().
-    *
-    */
+    int k = ( handle & 0xff ) - 1;
+    if ( ( k < 0 ) || ( k >= mNumSlots ) )
+    {
+        return -1;
+    }
+
+    if ( ( mInfo[ k ].generation != ( handle >> 8 ) ) || !mCallbacks[ k ].isValid() )
+    {
+        return -1;
+    }
+
+    return k;
+}
+
+
+#if EVENTMANAGER_TIME_LISTENERS
+
+void EventManagerBase::ListenerList::listenerTimed( int k, int eventCode, unsigned long elapsedMicros )
+{
+#if EVENTMANAGER_LISTENER_PROFILING
+    if ( k >= 0 )
+    {
+        ListenerProfile& profile = mInfo[ k ].profile;
+        profile.calls++;
+        profile.totalMicros += elapsedMicros;
+        if ( elapsedMicros > profile.maxMicros )
+        {
+            profile.maxMicros = elapsedMicros;
+        }
+    }
+#endif
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+    if ( mBudgetMicros && ( elapsedMicros > mBudgetMicros ) && mOverrunHook )
+    {
+        (*mOverrunHook)( ( k >= 0 ) ? handleOf( k ) : 0, eventCode, elapsedMicros );
+    }
+#else
+    (void) eventCode;
+#endif
+}
+
+#endif
+
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+
+void EventManagerBase::ListenerList::setListenerBudget( unsigned long budgetMicros, OverrunHook hook )
+{
+    mBudgetMicros = budgetMicros;
+    mOverrunHook = hook;
+}
+
+#endif
+
+
+#if EVENTMANAGER_LISTENER_PROFILING
+
+boolean EventManagerBase::ListenerList::getListenerProfile( ListenerHandle handle, ListenerProfile* profile )
+{
+    int k = slotOf( handle );
+    if ( k < 0 )
+    {
+        return false;
+    }
+
+    *profile = mInfo[ k ].profile;
+    return true;
+}
 
-    SuppressInterrupts  interruptsOff;      // Interrupts automatically restored when exit block
 
-    // ATOMIC BLOCK BEGIN
-    boolean retVal = false;
-    if ( !isFull() )
+void EventManagerBase::ListenerList::resetListenerProfiles()
+{
+    for ( int k = 0; k < mNumSlots; k++ )
     {
-        // Store the event at the tail of the queue
-        mEventQueue[ mEventQueueTail ].code = eventCode;
-        mEventQueue[ mEventQueueTail ].param = eventParam;
+        mInfo[ k ].profile.calls = 0;
+        mInfo[ k ].profile.totalMicros = 0;
+        mInfo[ k ].profile.maxMicros = 0;
+    }
+}
 
-        // Update queue tail value
-        mEventQueueTail = ( mEventQueueTail + 1 ) % kEventQueueSize;;
 
-        // Update number of events in queue
-        mNumEvents++;
+void EventManagerBase::ListenerList::dumpListenerProfiles( Print& out )
+{
+    // In dispatch order, which also gives each listener's event code
+    for ( int i = 0; i < mNumListeners + mNumPending; i++ )
+    {
+        int slot = mOrder[i];
+        if ( !mCallbacks[ slot ].isValid() )
+        {
+            continue;
+        }
 
-        retVal = true;
+        const ListenerInfo& info = mInfo[ slot ];
+        out.print( handleOf( slot ) );
+        out.print( "\t" );
+        if ( info.match == kMatchMask )
+        {
+            // value/mask, in hex
+            out.print( mCodes[i], HEX );
+            out.print( "/" );
+            out.print( info.matchData, HEX );
+        }
+        else
+        {
+            out.print( mCodes[i] );
+            if ( info.match == kMatchRange )
+            {
+                out.print( ".." );
+                out.print( info.matchData );
+            }
+        }
+        out.print( "\t" );
+        out.print( info.profile.calls );
+        out.print( "\t" );
+        out.print( info.profile.totalMicros );
+        out.print( "\t" );
+        out.println( info.profile.maxMicros );
     }
-    // ATOMIC BLOCK END
+}
 
-    return retVal;
+#endif
+
+
+
+EventManagerBase::CoalesceRules::CoalesceRules()
+{
+    for ( int i = 0; i < kNumRules; i++ )
+    {
+        mRules[i].mode = kNoCoalescing;
+    }
 }
 
 
-boolean EventManager::EventQueue::popEvent( int* eventCode, int* eventParam )
+boolean EventManagerBase::CoalesceRules::set( int eventCode, CoalesceMode mode )
 {
-    /*
-    * The call to noInterrupts() MUST come AFTER the empty queue check.
-    *
-    * There is no harm if the isEmpty() call returns an "incorrect" TRUE response because
-    * an asynchronous interrupt queued an event after isEmpty() was called but before the
-    * return is executed.  We'll pick up that asynchronously queued event the next time
-    * popEvent() is called.
-    *
-    * If interrupts are suppressed before the isEmpty() check, we pretty much lock-up the Arduino.
-    * This is because popEvent(), via processEvents(), is normally called inside loop(), which
-    * means it is called VERY OFTEN.  Most of the time (>99%), the event queue will be empty.
-    * But that means that we'll have interrupts turned off for a significant fraction of the
-    * time.  We don't want to do that.  We only want interrupts turned off when we are
-    * actually manipulating the queue.
-    *
-    * Contrast this with the logic in queueEvent().
-    *
-    */
+    int freeRule = -1;
+    for ( int i = 0; i < kNumRules; i++ )
+    {
+        if ( mRules[i].mode == kNoCoalescing )
+        {
+            if ( freeRule < 0 )
+            {
+                freeRule = i;
+            }
+        }
+        else if ( mRules[i].eventCode == eventCode )
+        {
+            mRules[i].mode = mode;
+            return true;
+        }
+    }
 
-    if ( isEmpty() )
+    if ( mode == kNoCoalescing )
+    {
+        return true;
+    }
+    if ( freeRule < 0 )
     {
         return false;
     }
 
-    SuppressInterrupts  interruptsOff;      // Interrupts automatically restored when exit block
+    mRules[ freeRule ].eventCode = eventCode;
+    mRules[ freeRule ].mode = mode;
+    return true;
+}
+
+
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+
+EventManagerBase::TimerWheel::TimerWheel() :
+mExpired( kNone ), mFree( 0 ), mNumRunning( 0 ), mNow( 0 )
+{
+    resetStats();
+    for ( int i = 0; i < kNumTimers; i++ )
+    {
+        mTimers[i].slot = kFree;
+        mTimers[i].next = ( i + 1 < kNumTimers ) ? i + 1 : kNone;
+        mTimers[i].generation = 0;
+    }
+    for ( int slot = 0; slot < kNumLevels * kNumSlots; slot++ )
+    {
+        mSlots[ slot ] = kNone;
+    }
+}
+
+
+EventManagerBase::TimerHandle EventManagerBase::TimerWheel::start( unsigned long now, unsigned long delay, unsigned long period,
+                                                                   int eventCode, int eventParam, EventPriority pri )
+{
+    if ( mFree == kNone )
+    {
+        return 0;
+    }
+
+    int i = mFree;
+    mFree = mTimers[i].next;
+
+    if ( !mNumRunning )
+    {
+        // The wheel stands still while no timer is running
+        mNow = now;
+    }
+    mNumRunning++;
+
+    Timer& timer = mTimers[i];
+    timer.expires = now + delay;
+    timer.period = period;
+    timer.eventCode = eventCode;
+    timer.eventParam = eventParam;
+    timer.priority = pri;
+    insert( i );
+
+    return ( timer.generation << 8 ) | ( i + 1 );
+}
+
 
-    // Pop the event from the head of the queue
-    // Store event code and event parameter into the user-supplied variables
-    *eventCode  = mEventQueue[ mEventQueueHead ].code;
-    *eventParam = mEventQueue[ mEventQueueHead ].param;
+boolean EventManagerBase::TimerWheel::cancel( TimerHandle handle )
+{
+    int i = timerOf( handle );
+    if ( i < 0 )
+    {
+        return false;
+    }
 
-    // Clear the event (paranoia)
-    mEventQueue[ mEventQueueHead ].code = EventManager::kEventNone;
+    unlink( i );
+    release( i );
+    return true;
+}
 
-    // Update the queue head value
-    mEventQueueHead = ( mEventQueueHead + 1 ) % kEventQueueSize;
 
-    // Update number of events in queue
-    mNumEvents--;
+boolean EventManagerBase::TimerWheel::peekExpired( unsigned long now, Event* event, EventPriority* pri )
+{
+    while ( mExpired == kNone )
+    {
+        if ( !mNumRunning || static_cast<long>( now - mNow ) < 0 )
+        {
+            return false;
+        }
 
+        // Over a short gap, ticking is cheaper than looking for the next busy tick
+        if ( now - mNow >= static_cast<unsigned long>( kNumSlots ) )
+        {
+            unsigned long next = nextBusyTick();
+            if ( next - mNow > now - mNow )
+            {
+                // Nothing happens up to now
+                mNow = now + 1;
+                return false;
+            }
+            mNow = next;
+        }
+        tick();
+    }
+
+    Timer& timer = mTimers[ mExpired ];
+    event->code = timer.eventCode;
+    event->param = timer.eventParam;
+    *pri = static_cast<EventPriority>( timer.priority );
     return true;
 }
+
+
+void EventManagerBase::TimerWheel::popExpired( unsigned long now )
+{
+    int i = mExpired;
+    Timer& timer = mTimers[i];
+    unlink( i );
+
+    if ( timer.period )
+    {
+        // Counting from when it expired rather than from now keeps a periodic timer from drifting
+        timer.expires += timer.period;
+
+        // But if processing fell a whole period (or more) behind, the event just queued stands
+        // for the periods missed as well:  skip to the first one still to come
+        unsigned long late = now - timer.expires;
+        if ( static_cast<long>( late ) >= 0 )
+        {
+            unsigned long missed = late / timer.period + 1;
+            timer.expires += missed * timer.period;
+            mStats.skipped += missed;
+        }
+        insert( i );
+    }
+    else
+    {
+        release( i );
+    }
+}
+
+
+int EventManagerBase::TimerWheel::timerOf( TimerHandle handle )
+{
+    int i = ( handle & 0xff ) - 1;
+    if ( ( i < 0 ) || ( i >= kNumTimers ) )
+    {
+        return -1;
+    }
+
+    if ( ( mTimers[i].slot == kFree ) || ( mTimers[i].generation != ( handle >> 8 ) ) )
+    {
+        return -1;
+    }
+
+    return i;
+}
+
+
+void EventManagerBase::TimerWheel::insert( int i )
+{
+    Timer& timer = mTimers[i];
+    unsigned long delta = timer.expires - mNow;
+
+    int slot;
+    if ( static_cast<long>( delta ) < 0 )
+    {
+        // Its tick has been handled already
+        slot = kExpired;
+    }
+    else
+    {
+        // The lowest level whose slots span enough ticks to reach it
+        int level = 0;
+        while ( ( level < kNumLevels - 1 ) && ( delta >> ( kSlotBits * ( level + 1 ) ) ) != 0 )
+        {
+            level++;
+        }
+        slot = level * kNumSlots + ( ( timer.expires >> ( kSlotBits * level ) ) & ( kNumSlots - 1 ) );
+    }
+
+    uint8_t& first = head( slot );
+    timer.slot = slot;
+    timer.prev = kNone;
+    timer.next = first;
+    if ( first != kNone )
+    {
+        mTimers[ first ].prev = i;
+    }
+    first = i;
+}
+
+
+void EventManagerBase::TimerWheel::unlink( int i )
+{
+    Timer& timer = mTimers[i];
+    if ( timer.prev != kNone )
+    {
+        mTimers[ timer.prev ].next = timer.next;
+    }
+    else
+    {
+        head( timer.slot ) = timer.next;
+    }
+    if ( timer.next != kNone )
+    {
+        mTimers[ timer.next ].prev = timer.prev;
+    }
+}
+
+
+void EventManagerBase::TimerWheel::release( int i )
+{
+    Timer& timer = mTimers[i];
+    timer.slot = kFree;
+    timer.generation++;
+    timer.next = mFree;
+    mFree = i;
+    mNumRunning--;
+}
+
+
+void EventManagerBase::TimerWheel::tick()
+{
+    // A slot of level L covers the span of the whole level below, so once that level has
+    // gone round, the next slot of level L is spread over it (which may in turn start a
+    // new round of the level above)
+    for ( int level = 1; level < kNumLevels; level++ )
+    {
+        if ( ( mNow >> ( kSlotBits * ( level - 1 ) ) ) & ( kNumSlots - 1 ) )
+        {
+            break;
+        }
+        cascade( level * kNumSlots + ( ( mNow >> ( kSlotBits * level ) ) & ( kNumSlots - 1 ) ) );
+    }
+
+    // Every timer in this tick's slot of level 0 expires now;  the expired list is empty
+    int slot = mNow & ( kNumSlots - 1 );
+    for ( int i = mSlots[ slot ]; i != kNone; i = mTimers[i].next )
+    {
+        mTimers[i].slot = kExpired;
+    }
+    mExpired = mSlots[ slot ];
+    mSlots[ slot ] = kNone;
+
+    mNow++;
+}
+
+
+void EventManagerBase::TimerWheel::cascade( int slot )
+{
+    int i = mSlots[ slot ];
+    mSlots[ slot ] = kNone;
+    while ( i != kNone )
+    {
+        int next = mTimers[i].next;
+        insert( i );
+        i = next;
+    }
+}
+
+
+unsigned long EventManagerBase::TimerWheel::nextBusyTick()
+{
+    // tick() handles slot s of level L at the ticks that are multiples of kNumSlots^L with
+    // s as their digit L:  find the first such tick for the first slot in use at each level
+    unsigned long best = ~0UL;
+    for ( int level = 0; level < kNumLevels; level++ )
+    {
+        int shift = kSlotBits * level;
+        unsigned long span = 1UL << shift;
+        unsigned long start = ( mNow + span - 1 ) & ~( span - 1 );
+        int digit = ( start >> shift ) & ( kNumSlots - 1 );
+
+        for ( int steps = 0; steps < kNumSlots; steps++ )
+        {
+            if ( mSlots[ level * kNumSlots + ( ( digit + steps ) & ( kNumSlots - 1 ) ) ] != kNone )
+            {
+                unsigned long wait = start + steps * span - mNow;
+                if ( wait < best )
+                {
+                    best = wait;
+                }
+                break;
+            }
+        }
+    }
+
+    return mNow + best;
+}
+
+#endif
+
+
+
+#if EVENTMANAGER_QUEUE_STATS
+
+EventManagerBase::QueueMonitor::QueueMonitor()
+{
+    resetQueueStats();
+}
+
+
+#if EVENTMANAGER_HAS_ATOMIC_RMW
+
+EventManagerBase::QueueStats EventManagerBase::QueueMonitor::getQueueStats()
+{
+    QueueStats stats;
+    stats.highWaterMark = __atomic_load_n( &mHighWaterMark, __ATOMIC_RELAXED );
+    stats.queued = __atomic_load_n( &mQueued, __ATOMIC_RELAXED );
+    stats.dropped = __atomic_load_n( &mDropped, __ATOMIC_RELAXED );
+    for ( int i = 0; i < kNumOccupancyBins; i++ )
+    {
+        stats.occupancy[i] = __atomic_load_n( &mOccupancy[i], __ATOMIC_RELAXED );
+    }
+    return stats;
+}
+
+
+void EventManagerBase::QueueMonitor::resetQueueStats()
+{
+    __atomic_store_n( &mHighWaterMark, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &mQueued, 0, __ATOMIC_RELAXED );
+    __atomic_store_n( &mDropped, 0, __ATOMIC_RELAXED );
+    for ( int i = 0; i < kNumOccupancyBins; i++ )
+    {
+        __atomic_store_n( &mOccupancy[i], 0, __ATOMIC_RELAXED );
+    }
+}
+
+#else
+
+// Multi-byte values can't be read in one instruction, so interrupts are suppressed
+// while they are copied (which also makes the copy a consistent snapshot)
+
+EventManagerBase::QueueStats EventManagerBase::QueueMonitor::getQueueStats()
+{
+    InterruptMask::Guard guard( mLock );
+
+    QueueStats stats;
+    stats.highWaterMark = mHighWaterMark;
+    stats.queued = mQueued;
+    stats.dropped = mDropped;
+    for ( int i = 0; i < kNumOccupancyBins; i++ )
+    {
+        stats.occupancy[i] = mOccupancy[i];
+    }
+    return stats;
+}
+
+
+void EventManagerBase::QueueMonitor::resetQueueStats()
+{
+    InterruptMask::Guard guard( mLock );
+
+    mHighWaterMark = 0;
+    mQueued = 0;
+    mDropped = 0;
+    for ( int i = 0; i < kNumOccupancyBins; i++ )
+    {
+        mOccupancy[i] = 0;
+    }
+}
+
+#endif
+
+#endif
+
+
+
+#if EVENTMANAGER_EVENT_LATENCY
+
+unsigned long EventManagerBase::latencyPercentile( const LatencyStats& stats, int percent )
+{
+    // The number of events, counting from the shortest wait, that the percentile must cover
+    unsigned long target = ( stats.events / 100 ) * percent + ( ( stats.events % 100 ) * percent + 99 ) / 100;
+
+    unsigned long count = 0;
+    for ( int bin = 0; bin < kNumLatencyBins - 1; bin++ )
+    {
+        count += stats.latency[ bin ];
+        if ( count >= target )
+        {
+            unsigned long top = ( 2UL << bin ) - 1;
+            return ( top < stats.maxLatency ) ? top : stats.maxLatency;
+        }
+    }
+    return stats.maxLatency;
+}
+
+#endif
@@ -45,20 +45,177 @@
 #define ISR_ATTR
 #endif
 
-// Size of the listener list.  Adjust as appropriate for your application.
-// Requires a total of sizeof(*f())+sizeof(int)+sizeof(boolean) bytes of RAM for each unit of size
+#if defined( ESP32 )
+#include <freertos/portmacro.h>
+#elif !defined( ARDUINO )
+#include <signal.h>
+#include <sched.h>
+#endif
+
+// std::mutex is only available on hosts and on the ESP32
+#if !defined( ARDUINO ) || defined( ESP32 )
+#define EVENTMANAGER_HAS_MUTEX      1
+#include <mutex>
+#endif
+
+// Lock-free multi-producer queues need an atomic compare-and-swap instruction (the ESP8266
+// has none:  GCC emulates it by disabling interrupts, which is not lock-free)
+#if !defined( __AVR_ARCH__ ) && !defined( __ARM_ARCH_6M__ ) && !defined( ESP8266 )
+#define EVENTMANAGER_HAS_CAS        1
+#endif
+
+// Flags and counters shared with interrupt handlers are updated with atomic read-modify-write
+// instructions where there are any, and by briefly suppressing interrupts elsewhere (define
+// as 0 to build as for a processor without them, e.g. to test that code on a host)
+#ifndef EVENTMANAGER_HAS_ATOMIC_RMW
+#if EVENTMANAGER_HAS_CAS
+#define EVENTMANAGER_HAS_ATOMIC_RMW     1
+#else
+#define EVENTMANAGER_HAS_ATOMIC_RMW     0
+#endif
+#endif
+
+// Default size of the listener list.  Adjust as appropriate for your application, or give
+// each manager its own capacities with SizedEventManager.
+// Requires ListenerList::kBytesPerListener bytes (and a bit) of RAM for each unit of size:  13 bytes
+// on AVR, 25 on 32-bit processors (ARM, ESP32), whose alignment pads the structures, and more with
+// EVENTMANAGER_LISTENER_PROFILING (at most 255)
 #ifndef EVENTMANAGER_LISTENER_LIST_SIZE
 #define EVENTMANAGER_LISTENER_LIST_SIZE		8
 #endif
 
-// Size of the event two queues.  Adjust as appropriate for your application.
+// Define as 1 to find the listeners for the event codes EVENTMANAGER_DIRECT_DISPATCH_FIRST to
+// EVENTMANAGER_DIRECT_DISPATCH_LAST (by default, the predefined EventType codes) with a table
+// indexed by event code instead of a binary search.  Other codes are still found by binary search.
+// Requires 1 byte of RAM for each code in the range.
+#ifndef EVENTMANAGER_DIRECT_DISPATCH
+#define EVENTMANAGER_DIRECT_DISPATCH		0
+#endif
+
+#ifndef EVENTMANAGER_DIRECT_DISPATCH_FIRST
+#define EVENTMANAGER_DIRECT_DISPATCH_FIRST	EventManagerBase::kEventNone
+#endif
+
+#ifndef EVENTMANAGER_DIRECT_DISPATCH_LAST
+#define EVENTMANAGER_DIRECT_DISPATCH_LAST	EventManagerBase::kEventUser9
+#endif
+
+// Default size of the two event queues.  Adjust as appropriate for your application, or give
+// each manager (and each queue) its own capacity with SizedEventManager.
 // Requires a total of 4 * sizeof(int) bytes of RAM for each unit of size
 #ifndef EVENTMANAGER_EVENT_QUEUE_SIZE
 #define EVENTMANAGER_EVENT_QUEUE_SIZE		8
 #endif
 
+// Maximum number of events processAllEvents() copies out of a queue at a time.  Each
+// batch is removed from the queue under a single lock (i.e., with interrupts suppressed
+// only once) and then dispatched with interrupts enabled.  The batch lives on the stack
+// and takes 2 * sizeof(int) bytes of it for each unit of size.
+#ifndef EVENTMANAGER_BATCH_SIZE
+#define EVENTMANAGER_BATCH_SIZE		8
+#endif
+
+// Default number of priority levels (2 to 8), each with its own event queue.  The
+// highest priority level gets the high priority queue size, every other level the low
+// priority queue size.  Give a manager a different number of levels with SizedEventManager.
+#ifndef EVENTMANAGER_PRIORITY_LEVELS
+#define EVENTMANAGER_PRIORITY_LEVELS		2
+#endif
+
+// Number of event codes that can have a coalescing mode (see EventManagerT::setCoalescing()).
+// Requires sizeof(int)+1 bytes of RAM for each unit of size.
+#ifndef EVENTMANAGER_COALESCE_LIST_SIZE
+#define EVENTMANAGER_COALESCE_LIST_SIZE		4
+#endif
+
+// Number of timers that can run at once (see EventManagerT::startTimer()), up to 255;  0 leaves
+// the timer service out.  Requires 2 * sizeof(long) + 2 * sizeof(int) + 5 bytes of RAM for each
+// unit of size (17 bytes on AVR, 24 on 32-bit processors, which pad it), plus about 140 bytes
+// for the timing wheel.
+#ifndef EVENTMANAGER_TIMER_LIST_SIZE
+#define EVENTMANAGER_TIMER_LIST_SIZE		0
+#endif
+
+// Clock whose ticks the timers count:  millis() by default, so delays are in milliseconds
+#ifndef EVENTMANAGER_TIMER_CLOCK
+#define EVENTMANAGER_TIMER_CLOCK()		millis()
+#endif
+
+// Lock policy used by the plain EventManager type.  By default each queue briefly
+// suppresses interrupts while it is modified, which is safe no matter how many contexts
+// queue events.  Defining one of these as 1 selects a lock-free queue instead (see
+// EventManagerBase::SpscLockFree and EventManagerBase::MpscLockFree).  Other lock
+// policies are selected by using EventManagerT directly.
+#ifndef EVENTMANAGER_SPSC_QUEUE
+#define EVENTMANAGER_SPSC_QUEUE		0
+#endif
+
+#ifndef EVENTMANAGER_MPSC_QUEUE
+#define EVENTMANAGER_MPSC_QUEUE		0
+#endif
+
+#if EVENTMANAGER_SPSC_QUEUE && EVENTMANAGER_MPSC_QUEUE
+#error "Define at most one of EVENTMANAGER_SPSC_QUEUE and EVENTMANAGER_MPSC_QUEUE"
+#endif
+
+#if EVENTMANAGER_MPSC_QUEUE && !EVENTMANAGER_HAS_CAS
+#error "EVENTMANAGER_MPSC_QUEUE requires an atomic compare-and-swap instruction, which this processor lacks"
+#endif
+
+
+// Define as 1 to have each event queue keep statistics on its use (see EventManagerT::getQueueStats()).
+// Requires about 12 * sizeof(long) bytes of RAM for each queue.
+#ifndef EVENTMANAGER_QUEUE_STATS
+#define EVENTMANAGER_QUEUE_STATS		0
+#endif
+
+// Define as 1 to time how long each event waits in its queue, from being queued until it is
+// dispatched (see EventManagerT::getLatencyStats()).  Requires 20 * sizeof(long) bytes of RAM
+// for each priority level, plus sizeof(long) for each queue slot.
+#ifndef EVENTMANAGER_EVENT_LATENCY
+#define EVENTMANAGER_EVENT_LATENCY		0
+#endif
+
+// The clock events are timestamped with when EVENTMANAGER_EVENT_LATENCY is 1:  micros() by
+// default, but any free-running unsigned counter that can be read from an interrupt handler
+// will do (e.g. a cycle counter), in which case latencies are in its ticks.
+#ifndef EVENTMANAGER_LATENCY_CLOCK
+#define EVENTMANAGER_LATENCY_CLOCK()		micros()
+#endif
+
+// Define as 1 to time each call of each listener with micros() (see EventManagerT::getListenerProfile()).
+// Requires 3 * sizeof(long) bytes of RAM for each unit of listener list size.
+#ifndef EVENTMANAGER_LISTENER_PROFILING
+#define EVENTMANAGER_LISTENER_PROFILING		0
+#endif
+
+// Define as 1 to check each call of each listener against a time budget, measured with micros()
+// (see EventManagerT::setListenerBudget()).  Requires 2 * sizeof(long) bytes of RAM.
+#ifndef EVENTMANAGER_LISTENER_WATCHDOG
+#define EVENTMANAGER_LISTENER_WATCHDOG		0
+#endif
+
+// Listener calls are timed if either of the above needs it
+#define EVENTMANAGER_TIME_LISTENERS		( EVENTMANAGER_LISTENER_PROFILING || EVENTMANAGER_LISTENER_WATCHDOG )
+
+
+#if EVENTMANAGER_DEBUG
+#define EVTMGR_DEBUG_PRINT( x )		Serial.print( x );
+#define EVTMGR_DEBUG_PRINTLN( x )	Serial.println( x );
+#define EVTMGR_DEBUG_PRINT_PTR( x )	Serial.print( reinterpret_cast<unsigned long>( x ), HEX );
+#define EVTMGR_DEBUG_PRINTLN_PTR( x )	Serial.println( reinterpret_cast<unsigned long>( x ), HEX );
+#else
+#define EVTMGR_DEBUG_PRINT( x )
+#define EVTMGR_DEBUG_PRINTLN( x )
+#define EVTMGR_DEBUG_PRINT_PTR( x )
+#define EVTMGR_DEBUG_PRINTLN_PTR( x )
+#endif
+
 
-class EventManager
+
+// Types and machinery shared by every EventManagerT, whatever its lock policy.
+// Use the EventManager type (or EventManagerT) rather than this class directly.
+class EventManagerBase
 {
 
 public:
@@ -66,12 +223,289 @@ public:
     // Type for an event listener (a.k.a. callback) function
     typedef void ( *EventListener )( int eventCode, int eventParam );
 
-    // EventManager recognizes two kinds of events.  By default, events are
-    // are queued as low priority, but these constants can be used to explicitly
-    // set the priority when queueing events
+    // Identifies a listener added with addListener() and friends, which return 0 if the listener
+    // could not be added.  A handle stops matching once its listener is removed (until its slot
+    // in the listener list has been reused 256 times).
+    typedef uint16_t ListenerHandle;
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+    // Identifies a timer started with startTimer() or startPeriodicTimer(), which return 0 if
+    // no timer is free.  A handle stops matching once its timer has expired or been cancelled.
+    typedef uint16_t TimerHandle;
+#endif
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+    // Type for the function called when a listener takes longer than its budget (see
+    // setListenerBudget()), with the listener's handle (0 for the default listener), the event
+    // code and the time the listener took, in microseconds
+    typedef void ( *OverrunHook )( ListenerHandle listener, int eventCode, unsigned long elapsedMicros );
+#endif
+
+    // Type for a listener that is also passed a pointer you supply when adding it
+    // (e.g., the object that handles the event)
+    typedef void ( *ContextListener )( void* context, int eventCode, int eventParam );
+
+    // Types for listeners that can consume the event:  returning true stops it from being
+    // sent to any further listeners
+    typedef boolean ( *ConsumingListener )( int eventCode, int eventParam );
+    typedef boolean ( *ConsumingContextListener )( void* context, int eventCode, int eventParam );
+
+    // A listener of any of these kinds, or a member function bound to an object:
+    //      Delegate( onEvent )                     calls onEvent( code, param )
+    //      Delegate( onEvent, &state )             calls onEvent( &state, code, param )
+    //      Delegate::bind< Motor, &Motor::onTick >( &motor )
+    //                                              calls motor.onTick( code, param )
+    // A Delegate is stored directly in the listener list (two pointers and a byte, no allocation);
+    // member functions are called through a small function generated for each method, and
+    // may return void or boolean (to consume the event).
+    class Delegate
+    {
+
+    public:
+
+        Delegate() : mContext( 0 ), mKind( kPlain ) { mFunction.plain = 0; }
+        Delegate( EventListener listener ) : mContext( 0 ), mKind( kPlain ) { mFunction.plain = listener; }
+        Delegate( ConsumingListener listener ) : mContext( 0 ), mKind( kConsuming ) { mFunction.consuming = listener; }
+        Delegate( ContextListener listener, void* context ) : mContext( context ), mKind( kContext ) { mFunction.context = listener; }
+        Delegate( ConsumingContextListener listener, void* context ) : mContext( context ), mKind( kConsumingContext ) { mFunction.consumingContext = listener; }
+
+        template< class T, void ( T::*Method )( int, int ) >
+        static Delegate bind( T* object )
+        {
+            return Delegate( &callMethod< T, Method >, object );
+        }
+
+        template< class T, boolean ( T::*Method )( int, int ) >
+        static Delegate bind( T* object )
+        {
+            return Delegate( &callConsumingMethod< T, Method >, object );
+        }
+
+        // Does the delegate have a function to call?
+        boolean isValid() const
+        {
+            switch ( mKind )
+            {
+                case kContext:          return mFunction.context != 0;
+                case kConsuming:        return mFunction.consuming != 0;
+                case kConsumingContext: return mFunction.consumingContext != 0;
+                default:                return mFunction.plain != 0;
+            }
+        }
+
+        // Calls the listener; returns true if it consumed the event
+        boolean operator()( int eventCode, int param ) const
+        {
+            switch ( mKind )
+            {
+                case kContext:
+                    (*mFunction.context)( mContext, eventCode, param );
+                    return false;
+
+                case kConsuming:
+                    return (*mFunction.consuming)( eventCode, param );
+
+                case kConsumingContext:
+                    return (*mFunction.consumingContext)( mContext, eventCode, param );
+
+                default:
+                    (*mFunction.plain)( eventCode, param );
+                    return false;
+            }
+        }
+
+        // Delegates are equal if they call the same function with the same context
+        boolean operator==( const Delegate& other ) const
+        {
+            if ( ( mKind != other.mKind ) || ( mContext != other.mContext ) )
+            {
+                return false;
+            }
+            switch ( mKind )
+            {
+                case kContext:          return mFunction.context == other.mFunction.context;
+                case kConsuming:        return mFunction.consuming == other.mFunction.consuming;
+                case kConsumingContext: return mFunction.consumingContext == other.mFunction.consumingContext;
+                default:                return mFunction.plain == other.mFunction.plain;
+            }
+        }
+
+#if EVENTMANAGER_DEBUG
+        // For debug output
+        unsigned long address() const
+        {
+            return mContext ? reinterpret_cast<unsigned long>( mContext ) : reinterpret_cast<unsigned long>( mFunction.plain );
+        }
+#endif
+
+    private:
+
+        template< class T, void ( T::*Method )( int, int ) >
+        static void callMethod( void* object, int eventCode, int param )
+        {
+            ( static_cast<T*>( object )->*Method )( eventCode, param );
+        }
+
+        template< class T, boolean ( T::*Method )( int, int ) >
+        static boolean callConsumingMethod( void* object, int eventCode, int param )
+        {
+            return ( static_cast<T*>( object )->*Method )( eventCode, param );
+        }
+
+        enum Kind { kPlain, kContext, kConsuming, kConsumingContext };
+
+        union
+        {
+            EventListener               plain;
+            ContextListener             context;
+            ConsumingListener           consuming;
+            ConsumingContextListener    consumingContext;
+        } mFunction;
+
+        void*   mContext;
+        uint8_t mKind;
+    };
+
+    // EventManager recognizes up to eight priority levels, kPriority0 being the highest.
+    // By default, events are queued as low priority (the lowest level the manager has),
+    // but these constants can be used to explicitly set the priority when queueing events.
+    // Levels beyond those a manager has are treated as its lowest level, so with the
+    // default two levels there is kHighPriority and everything else.
     //
-    // NOTE high priority events are always handled before any low priority events.
-    enum EventPriority { kHighPriority, kLowPriority };
+    // NOTE events are always handled before any events of lower priority.
+    enum EventPriority
+    {
+        kPriority0,
+        kPriority1,
+        kPriority2,
+        kPriority3,
+        kPriority4,
+        kPriority5,
+        kPriority6,
+        kPriority7,
+
+        kHighPriority = kPriority0,
+        kLowPriority = kPriority7
+    };
+
+    // The most priority levels an event manager can have
+    static const int kMaxPriorityLevels = 8;
+
+    // How queueEvents() treats a batch of events that does not fit in the queue:
+    // kAllOrNothing queues none of them, kAcceptPartial queues as many as fit (in order)
+    enum BatchMode { kAllOrNothing, kAcceptPartial };
+
+    // How queueEvent() treats an event whose code already has an event waiting in the queue
+    // (see setCoalescing()):  kNoCoalescing queues it as usual, the others merge its parameter
+    // into the waiting event instead, so it takes no queue slot and causes no extra dispatch.
+    // kCoalesceReplace keeps the latest parameter, kCoalesceSum adds the parameters, and
+    // kCoalesceOr ORs them together (e.g., for bit flags).
+    enum CoalesceMode { kNoCoalescing, kCoalesceReplace, kCoalesceSum, kCoalesceOr };
+
+    // What queueEvent() does when the queue is full (see setOverflowPolicy()):
+    // kDropNewest rejects the new event (the original behavior), kDropOldest discards the
+    // oldest queued event to make room, kOverwriteNewest replaces the most recently queued
+    // event with the new one, and kSpill stores it in a secondary buffer you supply, from
+    // which it moves back into the queue as room frees up.
+    enum OverflowPolicy { kDropNewest, kDropOldest, kOverwriteNewest, kSpill };
+
+    // Counts of the events affected by each queue's overflow policy
+    struct OverflowStats
+    {
+        unsigned int droppedNewest;     // new events rejected because the queue was full
+        unsigned int droppedOldest;     // queued events discarded to make room (kDropOldest)
+        unsigned int overwritten;       // queued events replaced by a newer one (kOverwriteNewest)
+        unsigned int spilled;           // events stored in the spill buffer (kSpill);  not lost
+    };
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+
+    // What became of timers whose events could not be queued on time (see EventManagerT::getTimerStats())
+    struct TimerStats
+    {
+        unsigned int deferred;          // times a timer's event found its queue full;  it is queued by a later call
+        unsigned int skipped;           // periods a periodic timer missed and queued no event for
+    };
+
+#endif
+
+#if EVENTMANAGER_QUEUE_STATS
+
+    // Number of bins in the occupancy histogram of QueueStats
+    static const int kNumOccupancyBins = 8;
+
+    // Statistics on the use of an event queue (see getQueueStats())
+    struct QueueStats
+    {
+        int             highWaterMark;      // the most events the queue has ever held
+        unsigned long   queued;             // events queued (not counting coalesced ones)
+        unsigned long   dropped;            // events lost:  rejected, discarded or overwritten
+
+        // occupancy[i] counts the times the queue held 2^i to 2^(i+1)-1 events right after
+        // an event (or a batch of events) was queued;  the last bin also counts anything more
+        unsigned long   occupancy[ kNumOccupancyBins ];
+    };
+
+#endif
+
+#if EVENTMANAGER_EVENT_LATENCY
+
+    // Number of bins in the latency histogram of LatencyStats
+    static const int kNumLatencyBins = 16;
+
+    // How long the events of a priority level waited in their queue (see getLatencyStats()),
+    // from being queued until they were dispatched, in ticks of EVENTMANAGER_LATENCY_CLOCK
+    // (microseconds by default)
+    struct LatencyStats
+    {
+        unsigned long   events;         // events dispatched
+        unsigned long   minLatency;     // shortest wait
+        unsigned long   maxLatency;     // longest wait
+        unsigned long   totalLatency;   // sum of the waits
+
+        // latency[i] counts the events that waited 2^i to 2^(i+1)-1 ticks;  the first bin
+        // also counts waits of 0 and the last bin anything longer
+        unsigned long   latency[ kNumLatencyBins ];
+    };
+
+    // The wait that at least percent percent of the events in stats did not exceed, estimated
+    // from the histogram:  the top of the bin it falls in, but no more than maxLatency
+    static unsigned long latencyPercentile( const LatencyStats& stats, int percent );
+
+#endif
+
+#if EVENTMANAGER_LISTENER_PROFILING
+
+    // How much time a listener has taken (see getListenerProfile());  times are in microseconds
+    struct ListenerProfile
+    {
+        unsigned long   calls;          // number of times the listener was called
+        unsigned long   totalMicros;    // total time taken by those calls
+        unsigned long   maxMicros;      // time taken by the slowest call
+    };
+
+#endif
+
+    // An event, for queueing several at once with queueEvents()
+    struct Event
+    {
+        int code;
+        int param;
+    };
+
+    // An entry of a spill buffer (see setOverflowPolicy()).  The same as an Event, except
+    // with EVENTMANAGER_EVENT_LATENCY, when it also keeps the time the event was queued, so
+    // that spilled events are timed from then rather than from when they reach the queue.
+#if EVENTMANAGER_EVENT_LATENCY
+    struct SpilledEvent
+    {
+        int code;
+        int param;
+        unsigned long queuedAt;
+    };
+#else
+    typedef Event SpilledEvent;
+#endif
 
     // Various pre-defined event type codes.  These are completely optional and
     // provided for convenience.  Any integer value can be used as an event code.
@@ -140,319 +574,3551 @@ public:
     };
 
 
-    // Create an event manager
-    // It always operates in interrupt safe mode, allowing you to queue events from interrupt handlers
-    EventManager();
 
-    // Add a listener
-    // Returns true if the listener is successfully installed, false otherwise (e.g. the dispatch table is full)
-    boolean addListener( int eventCode, EventListener listener );
+    // Lock policies
+    //
+    // A lock policy decides how each event queue is protected against events being
+    // queued from several contexts at once.  Every queue owns its own lock object, and
+    // each lock policy has a nested Guard class that holds the lock for its lifetime.
+    // Pick the cheapest policy that is safe for the way your code queues events.
 
-    // Remove (event, listener) pair (all occurrences)
-    // Other listeners with the same function or event code will not be affected
-    boolean removeListener( int eventCode, EventListener listener );
+    // No protection at all.  Use when events are only ever queued from the same
+    // context that processes them (e.g., only from loop(), never from interrupts).
+    // The critical sections compile away completely.
+    class NoLock
+    {
+    public:
 
-    // Remove all occurrances of a listener
-    // Removes this listener regardless of the event code; returns number removed
-    // Useful when one listener handles many different events
-    int removeListener( EventListener listener );
+        class Guard
+        {
+        public:
+            Guard( NoLock& ) {}
+        };
+    };
 
-    // Enable or disable a listener
-    // Return true if the listener was successfully enabled or disabled, false if the listener was not found
-    boolean enableListener( int eventCode, EventListener listener, boolean enable );
 
-    // Returns the current enabled/disabled state of the (eventCode, listener) combo
-    boolean isListenerEnabled( int eventCode, EventListener listener );
+    // Suppress interrupts while the queue is modified (the default).  Safe for any mix
+    // of interrupt handlers and normal code.  There is a different implementation for
+    // each architecture that has a different interrupt model.  #if macros ensure only
+    // one version is defined.
+    class InterruptMask
+    {
+    public:
 
-    // The default listener is a callback function that is called when an event with no listener is processed
-    // These functions set, clear, and enable/disable the default listener
-    boolean setDefaultListener( EventListener listener );
-    void removeDefaultListener();
-    void enableDefaultListener( boolean enable );
+#if defined( ESP32 )
+        InterruptMask()
+        {
+            portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+            mMux = unlocked;
+        }
+#endif
 
-    // Is the ListenerList empty?
-    boolean isListenerListEmpty();
+#if defined( __AVR_ARCH__ )
 
-    // Is the ListenerList full?
-    boolean isListenerListFull();
+        class Guard
+        {
+        public:
 
-    int numListeners();
+            // Record the current state and suppress interrupts when the object is instantiated.
+            Guard( InterruptMask& )
+            {
+                mInterruptsWereOn = (SREG & (1<<SREG_I));
+                cli();
+            }
 
-    // Returns true if no events are in the queue
-    boolean isEventQueueEmpty( EventPriority pri = kLowPriority );
+            // Restore whatever interrupt state was active before
+            ~Guard()
+            {
+                // Turn on global interrupts, only if they were already on
+                if ( mInterruptsWereOn )
+                {
+                    sei();
+                }
+            }
 
-    // Returns true if no more events can be inserted into the queue
-    boolean isEventQueueFull( EventPriority pri = kLowPriority );
+        private:
 
-    // Actual number of events in queue
-    int getNumEventsInQueue( EventPriority pri = kLowPriority );
+            uint8_t     mInterruptsWereOn;
+        };
 
-    // tries to insert an event into the queue;
-    // returns true if successful, false if the
-    // queue if full and the event cannot be inserted
-    boolean queueEvent( int eventCode, int eventParam, EventPriority pri = kLowPriority );
+#elif defined( SAM ) || defined( ARDUINO_ARCH_SAMD )
 
-    // this must be called regularly (usually by calling it inside the loop() function)
-    int processEvent();
+        class Guard
+        {
+        public:
 
-    // this function can be called to process ALL events in the queue
-    // WARNING:  if interrupts are adding events as fast as they are being processed
-    // this function might never return.  YOU HAVE BEEN WARNED.
-    int processAllEvents();
+            // Record the current state and suppress interrupts when the object is instantiated.
+            Guard( InterruptMask& )
+            {
+                mInterruptsWereOn = (__get_PRIMASK() == 0);
+                __disable_irq();
+            }
 
+            // Restore whatever interrupt state was active before
+            ~Guard()
+            {
+                // Turn on interrupts, only if they were already on
+                if ( mInterruptsWereOn )
+                {
+                    __enable_irq();
+                }
+            }
 
-private:
+        private:
 
-    // EventQueue class used internally by EventManager
-    class EventQueue
-    {
+            uint8_t     mInterruptsWereOn;
+        };
 
-    public:
+#elif defined( ESP8266 )
 
-        // Queue constructor
-        EventQueue();
+        class Guard
+        {
+        public:
 
-        // Returns true if no events are in the queue
-        boolean isEmpty();
+            // Record the current state and suppress interrupts when the object is instantiated.
+            Guard( InterruptMask& )
+            {
+                // This turns off interrupts and gets the old state in one function call
+                // See https://github.com/esp8266/Arduino/issues/615 for details
+                // level 15 will disable ALL interrupts,
+                // level 0 will enable ALL interrupts
+                mSavedInterruptState = xt_rsil( 15 );
+            }
 
-        // Returns true if no more events can be inserted into the queue
-        boolean isFull();
+            // Restore whatever interrupt state was active before
+            ~Guard()
+            {
+                // Restore the old interrupt state
+                xt_wsr_ps( mSavedInterruptState );
+            }
 
-        // Actual number of events in queue
-        int getNumEvents();
+        private:
 
-        // Tries to insert an event into the queue;
-        // Returns true if successful, false if the queue if full and the event cannot be inserted
-        //
-        // NOTE: if EventManager is instantiated in interrupt safe mode, this function can be called
-        // from interrupt handlers.  This is the ONLY EventManager function that can be called from
-        // an interrupt.
-        boolean queueEvent( int eventCode, int eventParam );
+            uint32_t    mSavedInterruptState;
+        };
 
-        // Tries to extract an event from the queue;
-        // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
-        boolean popEvent( int* eventCode, int* eventParam );
+#elif defined( CORE_TEENSY )
 
-    private:
+        class Guard
+        {
+        public:
 
-        // Event queue size.
-        // The maximum number of events the queue can hold is kEventQueueSize
-        // Increasing this number will consume 2 * sizeof(int) bytes of RAM for each unit.
-        static const int kEventQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+            //Reference: https://www.pjrc.com/teensy/interrupts.html
+            //Backup the interrupt enable state and restore it
+            Guard( InterruptMask& )
+            {
+                mSregBackup = SREG;     /* save interrupt enable/disable state */
+                cli();                  /* disable the global interrupt */
+            }
 
-        struct EventElement
-        {
-            int code;	// each event is represented by an integer code
-            int param;	// each event has a single integer parameter
-        };
+            ~Guard()
+            {
+                SREG = mSregBackup;     /* restore interrupt state */
+            }
 
-        // The event queue
-        EventElement mEventQueue[ kEventQueueSize ];
+        private:
 
-        // Index of event queue head
-        int mEventQueueHead;
+            uint8_t mSregBackup;
+        };
 
-        // Index of event queue tail
-        int mEventQueueTail;
+#elif defined( ESP32 )
 
-        // Actual number of events in queue
-        int mNumEvents;
-    };
+        class Guard
+        {
+        public:
 
+            // Reference: https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-guides/freertos-smp.html#critical-sections-disabling-interrupts
+            // Enter critical section, using the queue's own spinlock so both cores are excluded too
+            Guard( InterruptMask& lock ) :
+            mLock( lock )
+            {
+                portENTER_CRITICAL( &mLock.mMux );
+            }
 
-    // ListenerList class used internally by EventManager
-    class ListenerList
-    {
+            // Exit critical section
+            ~Guard()
+            {
+                portEXIT_CRITICAL( &mLock.mMux );
+            }
 
-    public:
+        private:
 
-        // Create an event manager
-        ListenerList();
+            InterruptMask&  mLock;
+        };
 
-        // Add a listener
-        // Returns true if the listener is successfully installed, false otherwise (e.g. the dispatch table is full)
-        boolean addListener( int eventCode, EventListener listener );
+    private:
 
-        // Remove event listener pair (all occurrences)
-        // Other listeners with the same function or eventCode will not be affected
-        boolean removeListener( int eventCode, EventListener listener );
+        portMUX_TYPE    mMux;
 
-        // Remove all occurrances of a listener
-        // Removes this listener regardless of the eventCode; returns number removed
-        int removeListener( EventListener listener );
+#elif !defined( ARDUINO )
 
-        // Enable or disable a listener
-        // Return true if the listener was successfully enabled or disabled, false if the listener was not found
-        boolean enableListener( int eventCode, EventListener listener, boolean enable );
+        InterruptMask() :
+        mLocked( false )
+        {
+        }
 
-        boolean isListenerEnabled( int eventCode, EventListener listener );
+        class Guard
+        {
+        public:
 
-        // The default listener is a callback function that is called when an event with no listener is processed
-        boolean setDefaultListener( EventListener listener );
-        void removeDefaultListener();
-        void enableDefaultListener( boolean enable );
+            // Host build:  signals play the role of interrupts, so block them all, and threads
+            // that of other cores, so also take the queue's own spinlock.  Signals are blocked
+            // first, so that a signal handler never spins on a lock held by the code it interrupted.
+            Guard( InterruptMask& lock ) :
+            mLock( lock )
+            {
+                sigset_t all;
+                sigfillset( &all );
+                pthread_sigmask( SIG_BLOCK, &all, &mSavedMask );
 
-        // Is the ListenerList empty?
-        boolean isEmpty();
+                while ( __atomic_test_and_set( &mLock.mLocked, __ATOMIC_ACQUIRE ) )
+                {
+                    // The holder may be a thread waiting for this CPU
+                    sched_yield();
+                }
+            }
 
-        // Is the ListenerList full?
-        boolean isFull();
+            // Release the lock and restore the previous signal mask
+            ~Guard()
+            {
+                __atomic_clear( &mLock.mLocked, __ATOMIC_RELEASE );
+                pthread_sigmask( SIG_SETMASK, &mSavedMask, 0 );
+            }
 
-        // Send an event to the listeners; returns number of listeners that handled the event
-        int sendEvent( int eventCode, int param );
+        private:
 
-        int numListeners();
+            InterruptMask&  mLock;
+            sigset_t        mSavedMask;
+        };
 
     private:
 
-        // Maximum number of event/callback entries
-        // Can be changed to save memory or allow more events to be dispatched
-        static const int kMaxListeners = EVENTMANAGER_LISTENER_LIST_SIZE;
+        bool    mLocked;
 
-        // Actual number of event listeners
-        int mNumListeners;
+#else
+
+#error "Unknown microcontroller:  Need to implement class InterruptMask::Guard for this microcontroller."
+
+#endif
+    };
+
+
+#if EVENTMANAGER_HAS_MUTEX
+
+    // Protect each queue with a std::mutex.  For events queued from several threads
+    // or FreeRTOS tasks.  NOT for use from interrupt handlers.
+    class MutexLock
+    {
+    public:
+
+        class Guard
+        {
+        public:
+
+            Guard( MutexLock& lock ) :
+            mLock( lock )
+            {
+                mLock.mMutex.lock();
+            }
+
+            ~Guard()
+            {
+                mLock.mMutex.unlock();
+            }
+
+        private:
+
+            MutexLock&  mLock;
+        };
+
+    private:
+
+        std::mutex  mMutex;
+    };
+
+#endif
+
+
+#if !defined( __AVR_ARCH__ )
+
+    // Protect each queue with a spinlock.  For events queued from threads or tasks running
+    // on different cores.  NOT for use from interrupt handlers (an interrupt that spins on a
+    // lock held by the code it interrupted never returns).
+    class SpinLock
+    {
+    public:
+
+        SpinLock() :
+        mLocked( false )
+        {
+        }
+
+        class Guard
+        {
+        public:
+
+            Guard( SpinLock& lock ) :
+            mLock( lock )
+            {
+                while ( __atomic_test_and_set( &mLock.mLocked, __ATOMIC_ACQUIRE ) )
+                {
+                    // spin
+                }
+            }
+
+            ~Guard()
+            {
+                __atomic_clear( &mLock.mLocked, __ATOMIC_RELEASE );
+            }
+
+        private:
+
+            SpinLock&   mLock;
+        };
+
+    private:
+
+        bool    mLocked;
+    };
+
+#endif
+
+
+    // Lock-free single-producer/single-consumer queue.  The producer only ever writes
+    // the tail index and the consumer only ever writes the head index, so neither side
+    // needs a lock or suppresses interrupts.
+    //
+    // NOTE: only ONE context may queue events into a given queue and only ONE context
+    // may process them.  If, for example, an interrupt handler and loop() both queue
+    // events with the same priority, use InterruptMask instead.  Timers count as well:
+    // their events are queued by the context that processes events, so only start timers
+    // with a priority whose events no other context queues.
+    class SpscLockFree {};
+
+    // Lock-free multi-producer/single-consumer queue.  Any number of tasks (on either
+    // ESP32 core) and interrupt handlers may queue events concurrently; producers reserve
+    // slots with an atomic compare-and-swap.  Requires a processor with compare-and-swap
+    // (e.g., ESP32, not AVR) and a power of two queue size.  Only ONE context may process events.
+    class MpscLockFree {};
+
+
+    // Wraps another lock policy to select a queue whose size must be a power of two.
+    // The queue keeps free-running head and tail counters and indexes its slots with a
+    // mask, so queueing and popping need no division (a slow software routine on AVR)
+    // and the number of queued events is a simple subtraction.  For example
+    //      EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > >
+    template< class LockPolicy >
+    class PowerOfTwoRing : public LockPolicy {};
+
+
+#if EVENTMANAGER_SPSC_QUEUE
+    typedef SpscLockFree    DefaultLockPolicy;
+#elif EVENTMANAGER_MPSC_QUEUE
+    typedef MpscLockFree    DefaultLockPolicy;
+#else
+    typedef InterruptMask   DefaultLockPolicy;
+#endif
+
+
+
+    // Static dispatch
+    //
+    // When the listeners are fixed at compile time, they can be listed in a StaticDispatcher
+    // instead of being added with addListener(), e.g.
+    //      typedef EventManager::StaticDispatcher<
+    //                  EventManager::On< EventManager::kEventKeyPress, onKeyPress >,
+    //                  EventManager::On< EventManager::kEventPaint, onPaint > > MyDispatcher;
+    // and events processed with processEvent< MyDispatcher >().  The compiler turns the list
+    // into a series of comparisons with direct (inlinable) calls, so these listeners take no
+    // RAM at all and cost no lookup at run time.
+
+    // A listener for one event code
+    template< int EventCode, EventListener Listener >
+    class On {};
+
+    // Sends events to the listeners in Handlers, a list of On<> entries (specialized below;
+    // this version is the empty list)
+    template< class... Handlers >
+    class StaticDispatcher
+    {
+        static_assert( sizeof...( Handlers ) == 0, "StaticDispatcher takes a list of On<> entries" );
+
+    public:
+
+        // Returns the number of listeners that handled the event
+        static int sendEvent( int, int ) { return 0; }
+    };
+
+
+protected:
+
+    struct EventElement
+    {
+        int code;	// each event is represented by an integer code
+        int param;	// each event has a single integer parameter
+#if EVENTMANAGER_EVENT_LATENCY
+        unsigned long queuedAt;     // EVENTMANAGER_LATENCY_CLOCK() when the event was queued
+#endif
+    };
+
+#if EVENTMANAGER_EVENT_LATENCY
+    // Records in event the time it is being queued
+    static void stampQueued( EventElement* event );
+#else
+    static void stampQueued( EventElement* ) {}
+#endif
+
+    // Number of events out of a batch of numEvents that queueEvents() inserts given room free slots
+    static int batchCount( int numEvents, int room, BatchMode mode );
+
+    // Merges eventParam into the parameter of an event already waiting in a queue
+    static void coalesce( int* pendingParam, int eventParam, CoalesceMode mode );
+
+    // Access to a queue counter that isEmpty(), isFull() and getNumEvents() read without
+    // taking the queue's lock:  the writer (under the lock) publishes it with storeShared()
+    // and unlocked readers see it through loadShared()
+    template< class T > static T loadShared( const T& counter );
+    template< class T > static void storeShared( T& counter, T value );
+
+
+#if EVENTMANAGER_QUEUE_STATS
+
+    // Keeps the statistics of an event queue.  The counters can be updated from any context
+    // (including concurrent producers) and each can be read at any time, without taking the
+    // queue's lock.
+    class QueueMonitor
+    {
+
+    public:
+
+        QueueMonitor();
+
+        // numEvents were queued, leaving occupancy events in the queue
+        void recordQueued( int numEvents, int occupancy );
+
+        // numEvents were lost
+        void recordDropped( int numEvents );
+
+        QueueStats getQueueStats();
+        void resetQueueStats();
+
+    private:
+
+        static int occupancyBin( int occupancy );
+
+        void add( volatile unsigned long* counter, unsigned long n );
+
+        volatile int            mHighWaterMark;
+        volatile unsigned long  mQueued;
+        volatile unsigned long  mDropped;
+        volatile unsigned long  mOccupancy[ kNumOccupancyBins ];
+
+#if !EVENTMANAGER_HAS_ATOMIC_RMW
+        InterruptMask           mLock;
+#endif
+    };
+
+#else
+
+    // Statistics are disabled:  an empty base class that records nothing
+    class QueueMonitor
+    {
+
+    public:
+
+        void recordQueued( int, int ) {}
+        void recordDropped( int ) {}
+    };
+
+#endif
+
+
+    // The spill buffer of a locked queue whose overflow policy is kSpill:  a ring buffer
+    // in storage supplied by the user.  Only accessed with the queue's lock held.
+    class SpillBuffer
+    {
+
+    public:
+
+        SpillBuffer();
+
+        // Use the size entries of events[] as storage (0 for none);  discards any events held
+        void setStorage( SpilledEvent* events, int size );
+
+        boolean isEmpty();
+
+        int getNumEvents();
+
+        // Adds an event after the newest one;  returns false if the buffer is full
+        boolean push( int eventCode, int eventParam );
+
+        // Removes the oldest event into *event (with the time it was queued);  returns false
+        // if the buffer is empty
+        boolean pop( EventElement* event );
+
+        // Returns the newest event with this code, or 0 if there is none
+        SpilledEvent* findNewest( int eventCode );
+
+    private:
+
+        SpilledEvent*   mEvents;
+        int     mSize;
+        int     mHead;
+        int     mNumEvents;
+    };
+
+
+    // Table of the event codes that are coalesced, and how
+    class CoalesceRules
+    {
+
+    public:
+
+        CoalesceRules();
+
+        // Sets the mode for eventCode;  kNoCoalescing removes it from the table.
+        // Returns false if the table is full
+        boolean set( int eventCode, CoalesceMode mode );
+
+        // Returns the mode for eventCode (kNoCoalescing if it is not in the table)
+        CoalesceMode find( int eventCode );
+
+    private:
+
+        static const int kNumRules = EVENTMANAGER_COALESCE_LIST_SIZE;
+
+        struct Rule
+        {
+            int         eventCode;
+            uint8_t     mode;       // a CoalesceMode; kNoCoalescing marks a free entry
+        };
+
+        Rule mRules[ kNumRules > 0 ? kNumRules : 1 ];
+    };
+
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+
+    // The timers of the timer service, kept in a hierarchical timing wheel:  kNumLevels wheels of
+    // kNumSlots slots, each slot of level L holding the timers due within one span of
+    // kNumSlots^L ticks.  Starting and cancelling a timer take constant time;  each tick empties
+    // one slot of level 0, and every kNumSlots^L ticks a slot of level L is spread over the
+    // levels below.  Ticks with empty slots are skipped, so catching up after a long gap costs
+    // no more than a short one.  Only used from the context that processes events.
+    class TimerWheel
+    {
+
+    public:
+
+        TimerWheel();
+
+        // Starts a timer that expires delay ticks after now, and then every period ticks unless
+        // period is 0;  returns 0 if every timer is in use
+        TimerHandle start( unsigned long now, unsigned long delay, unsigned long period,
+                           int eventCode, int eventParam, EventPriority pri );
+
+        // Returns false if handle is not a running timer
+        boolean cancel( TimerHandle handle );
+        boolean isRunning( TimerHandle handle );
+
+        // Advances the wheel up to now, until a timer expires;  returns false if none has by
+        // now, otherwise sets *event and *pri to what it queues
+        boolean peekExpired( unsigned long now, Event* event, EventPriority* pri );
+
+        // Removes the timer found by peekExpired() (or restarts it if it is periodic, skipping
+        // any periods that have already passed by now)
+        void popExpired( unsigned long now );
+
+        // Counts a call that could not queue the event of the timer found by peekExpired()
+        void deferExpired();
+
+        TimerStats getStats();
+        void resetStats();
+
+    private:
+
+        static const int kNumTimers = EVENTMANAGER_TIMER_LIST_SIZE;
+
+        static const int kSlotBits = 4;
+        static const int kNumSlots = 1 << kSlotBits;
+        static const int kNumLevels = ( 32 + kSlotBits - 1 ) / kSlotBits;
+
+        // Values of Timer::slot for a timer that is not in the wheel:  one on the expired list,
+        // or a free one
+        static const uint8_t kExpired = kNumLevels * kNumSlots;
+        static const uint8_t kFree = 0xff;
+
+        // Marks the end of a list of timers
+        static const uint8_t kNone = 0xff;
+
+        static_assert( kNumTimers > 0 && kNumTimers <= 255, "EventManager supports 0 to 255 timers" );
+
+        struct Timer
+        {
+            unsigned long   expires;        // tick it expires at
+            unsigned long   period;         // 0 for a one-shot timer
+            int             eventCode;
+            int             eventParam;
+            uint8_t         priority;
+            uint8_t         slot;           // wheel slot it is in, kExpired or kFree
+            uint8_t         next;           // the timers in the same slot, in a doubly linked list
+                                            // (free timers are linked through next alone)
+            uint8_t         prev;
+            uint8_t         generation;     // incremented each time the timer is freed
+        };
+
+        // Index of the timer with the given handle, or -1 if it is not running
+        int timerOf( TimerHandle handle );
+
+        // Puts timer i into the slot for its expiry time, or into the expired list if it is due
+        void insert( int i );
+        void unlink( int i );
+
+        // Frees timer i, which is not in any list
+        void release( int i );
+
+        // Handles tick mNow:  spreads the slots of the higher levels whose span starts with it
+        // over the levels below, and moves the slot of level 0 it belongs to onto the expired list
+        void tick();
+
+        // Takes every timer out of slot and inserts it again
+        void cascade( int slot );
+
+        // The first tick from mNow on that has a slot to empty or spread;  there must be a
+        // timer in the wheel
+        unsigned long nextBusyTick();
+
+        uint8_t& head( int slot );
+
+        Timer           mTimers[ kNumTimers ];
+        uint8_t         mSlots[ kNumLevels * kNumSlots ];
+        uint8_t         mExpired;           // timers that have expired but not been popped
+        uint8_t         mFree;
+        uint8_t         mNumRunning;
+        unsigned long   mNow;               // the next tick to handle
+        TimerStats      mStats;
+    };
+
+#endif
+
+
+    // Bitmap of the Levels priority levels that may have events queued, bit 0 being the
+    // highest priority level.  Producers (possibly interrupt handlers or other cores) set a
+    // level's bit after queueing into it; the event processing code clears it when the
+    // level's queue runs empty.  The highest priority level with events is thus found in
+    // constant time no matter how many levels there are.
+    // Without atomic read-modify-write instructions, each level has a byte of its own
+    // instead, which is set and cleared with a single store, so that updating it never
+    // needs a critical section either:  the lock-free and NoLock queues stay free of them.
+    template< int Levels >
+    class ReadyLevels
+    {
+
+    public:
+
+        ReadyLevels();
+
+        uint8_t get();
+
+        void set( int level );
+        void clear( int level );
+
+        // Returns the number of the highest priority (i.e., lowest numbered) level in bits, which must not be 0
+        static int highest( uint8_t bits );
+
+    private:
+
+#if EVENTMANAGER_HAS_ATOMIC_RMW
+        volatile uint8_t    mBits;
+#else
+        volatile uint8_t    mReady[ Levels ];
+#endif
+    };
+
+
+    // EventQueue class used internally by EventManager
+    // The lock policy and the statistics are base classes so that an empty lock (or
+    // disabled statistics) takes no RAM.  Specialized below for the lock-free policies.
+    template< int Size, class LockPolicy >
+    class EventQueue : private LockPolicy, public QueueMonitor
+    {
+
+    public:
+
+        // Queue constructor
+        EventQueue();
+
+        // Returns true if no events are in the queue
+        boolean isEmpty();
+
+        // Returns true if no more events can be inserted into the queue
+        boolean isFull();
+
+        // Actual number of events in queue
+        int getNumEvents();
+
+        // Tries to insert an event into the queue;
+        // Returns true if successful, false if the queue if full and the event cannot be inserted
+        //
+        // NOTE: if EventManager is instantiated in interrupt safe mode, this function can be called
+        // from interrupt handlers.  This is the ONLY EventManager function that can be called from
+        // an interrupt.
+        boolean queueEvent( int eventCode, int eventParam );
+
+        // Same as queueEvent( eventCode, eventParam ), except that if an event with the same code is
+        // already in the queue, eventParam is merged into the newest such event according to mode
+        boolean queueEvent( int eventCode, int eventParam, CoalesceMode mode );
+
+        // Tries to insert numEvents events into the queue, holding the lock only once;
+        // Returns the number inserted (in kAllOrNothing mode either all or none of them)
+        int queueEvents( const Event* events, int numEvents, BatchMode mode );
+
+        // Tries to extract an event from the queue;
+        // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
+        boolean popEvent( int* eventCode, int* eventParam );
+
+        // Extracts up to maxEvents events from the head of the queue into events[], oldest first,
+        // holding the lock only once for the whole run;  returns the number extracted
+        int popEvents( EventElement* events, int maxEvents );
+
+        // Sets what queueEvent() does when the queue is full;  kSpill requires a spill buffer.
+        // Returns false if the arguments are invalid or events are still waiting in the old spill buffer
+        boolean setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize );
+
+        OverflowStats getOverflowStats();
+        void resetOverflowStats();
+
+    private:
+
+        // Stores an event at the tail, applying the overflow policy if the queue is full;
+        // call only with the lock held
+        boolean insertEvent( int eventCode, int eventParam );
+
+        // Moves spilled events back into the queue as far as there is room;  call only with the lock held
+        void refill();
+
+        // Event queue size.
+        // The maximum number of events the queue can hold is kEventQueueSize
+        // Increasing this number will consume 2 * sizeof(int) bytes of RAM for each unit.
+        static const int kEventQueueSize = Size;
+
+        typedef typename LockPolicy::Guard Guard;
+
+        // The event queue
+        EventElement mEventQueue[ kEventQueueSize ];
+
+        // Index of event queue head
+        int mEventQueueHead;
+
+        // Index of event queue tail
+        int mEventQueueTail;
+
+        // Actual number of events in queue
+        int mNumEvents;
+
+        uint8_t         mOverflowPolicy;
+        OverflowStats   mOverflowStats;
+        SpillBuffer     mSpill;
+    };
+
+
+    // ListenerList class used internally by EventManager
+    class ListenerList
+    {
+
+    public:
+
+        // How a listener matches event codes:  a single code, a range of codes, or a
+        // code pattern (the code ANDed with a mask); kMatchNone marks a free slot
+        enum Match { kMatchCode, kMatchRange, kMatchMask, kMatchNone };
+
+        // The details of a listener that sendEvent() only needs once it has found the listener
+        // (the rest of it is kept in separate arrays, see below)
+        struct ListenerInfo
+        {
+            int				matchData;		// The last code of a range, the mask of a pattern
+            uint8_t			match;			// One of the Match values
+            int8_t			priority;		// Listeners with higher priority are called first
+            uint8_t			generation;		// Changes each time the slot is freed, so old handles stop matching
+#if EVENTMANAGER_LISTENER_PROFILING
+            ListenerProfile	profile;		// The time taken by the listener
+#endif
+        };
+
+        // RAM each listener takes in the arrays of a ListenerStorage (plus one bit in mEnabled)
+        static const int kBytesPerListener = sizeof( Delegate ) + sizeof( ListenerInfo ) + sizeof( int ) + sizeof( uint8_t );
+
+        // Create a list of up to maxListeners listeners, kept in arrays supplied by the owner of
+        // the list (see ListenerStorage)
+        ListenerList( Delegate* callbacks, ListenerInfo* info, uint8_t* enabled, uint8_t* order, int* codes, int maxListeners );
+
+        // Add a listener
+        // Returns a handle for the listener if it is successfully installed, 0 otherwise (e.g. the dispatch table is full)
+        ListenerHandle addListener( int eventCode, const Delegate& listener, int8_t priority );
+
+        // Add a listener for the event codes firstCode to lastCode, or for the codes that give
+        // value when ANDed with mask, using a single entry
+        ListenerHandle addRangeListener( int firstCode, int lastCode, const Delegate& listener, int8_t priority );
+        ListenerHandle addMaskListener( int value, int mask, const Delegate& listener, int8_t priority );
+
+        // Remove, enable or disable the listener with the given handle
+        // Return false if the handle no longer matches a listener
+        boolean removeListener( ListenerHandle handle );
+        boolean enableListener( ListenerHandle handle, boolean enable );
+        boolean isListenerEnabled( ListenerHandle handle );
+
+        // Remove event listener pair (all occurrences)
+        // Other listeners with the same function or eventCode will not be affected
+        boolean removeListener( int eventCode, const Delegate& listener );
+
+        // Remove all occurrances of a listener
+        // Removes this listener regardless of the eventCode; returns number removed
+        int removeListener( const Delegate& listener );
+
+        // Enable or disable a listener
+        // Return true if the listener was successfully enabled or disabled, false if the listener was not found
+        boolean enableListener( int eventCode, const Delegate& listener, boolean enable );
+
+        boolean isListenerEnabled( int eventCode, const Delegate& listener );
+
+        // The default listener is a callback function that is called when an event with no listener is processed
+        boolean setDefaultListener( EventListener listener );
+        void removeDefaultListener();
+        void enableDefaultListener( boolean enable );
+
+        // Is the ListenerList empty?
+        boolean isEmpty();
+
+        // Is the ListenerList full?
+        boolean isFull();
+
+        // Send an event to the listeners; returns number of listeners that handled the event
+        // If the event was alreadyHandled elsewhere, the default listener is not called
+        int sendEvent( int eventCode, int param, boolean alreadyHandled = false );
+
+        int numListeners();
+
+#if EVENTMANAGER_LISTENER_PROFILING
+        // The time taken by a listener, and by all listeners
+        boolean getListenerProfile( ListenerHandle handle, ListenerProfile* profile );
+        void resetListenerProfiles();
+        void dumpListenerProfiles( Print& out );
+#endif
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+        // Calls hook whenever a listener takes more than budgetMicros (0 for no budget)
+        void setListenerBudget( unsigned long budgetMicros, OverrunHook hook );
+#endif
+
+    private:
+
+        // The listeners are kept as a structure of arrays, each indexed by the listener's slot:
+        // its function, its other details and (one bit per slot) whether it is enabled.
+        // The maximum number of listeners is the number of slots.
+        Delegate* mCallbacks;
+        ListenerInfo* mInfo;
+        uint8_t* mEnabled;
+        int mMaxListeners;
+
+        // Dispatch index:  the slots of the listeners.  The first mNumCodeListeners are the
+        // single code listeners, sorted by event code, then by decreasing priority (listeners
+        // with the same code and priority stay in the order they were added).  sendEvent()
+        // binary searches them, so it only looks at the listeners for the event it sends.
+        // The range and pattern listeners follow, sorted by decreasing priority, and sendEvent()
+        // checks each of them.
+        uint8_t* mOrder;
+
+        // The event code of each entry of mOrder (the first code of a range, the value of a
+        // pattern), kept in order alongside it so that searching the index only reads these
+        int* mCodes;
+
+        // Number of entries in mOrder, and how many of them are single code listeners
+        // Removed listeners are left in place as tombstones (with no callback), which sendEvent()
+        // skips, and mNumRemoved counts them.  compact() drops them from mOrder and frees their
+        // slots, which is done before a listener is added, so removal itself is O(1).
+        int mNumListeners;
+        int mNumCodeListeners;
+        int mNumRemoved;
+
+        // Listeners added during a dispatch are not put in the index until it is done, which
+        // would move the entries under it; until then their slots are listed in mOrder (and
+        // their codes in mCodes), just after the index (there is always room, since each entry
+        // has a slot of its own)
+        int mNumPending;
+
+        // Number of slots that have ever been used; slots never move, so a
+        // listener's handle is its slot number (plus one) and the slot's generation
+        int mNumSlots;
+
+        // How many calls of sendEvent() are under way (listeners may send events themselves)
+        uint8_t mDispatchDepth;
+
+        // Callback function to be called for event types which have no listener
+        EventListener mDefaultCallback;
+
+        // Once set, the default callback function can be enabled or disabled
+        boolean mDefaultCallbackEnabled;
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+        // The longest a listener may take, and what to call when it takes longer
+        unsigned long mBudgetMicros;
+        OverrunHook mOverrunHook;
+#endif
+
+#if EVENTMANAGER_TIME_LISTENERS
+        // records the time taken by a call of the listener in slot k (-1 for the default listener)
+        void listenerTimed( int k, int eventCode, unsigned long elapsedMicros );
+#endif
+
+        // returns the handle of the listener in slot k
+        ListenerHandle handleOf( int k );
+
+        // get the current number of entries in the dispatch table
+        int getNumEntries();
+
+        // returns the array index of the specified listener or -1 if no such event/function couple is found
+        int searchListeners( int eventCode, const Delegate& listener );
+        int searchListeners( const Delegate& listener );
+        int searchEventCode( int eventCode );
+
+        // returns the first position in mOrder of a listener for eventCode (or for a greater code)
+        int firstListener( int eventCode );
+
+        // returns the position in mOrder just past the last listener for eventCode
+        int endListener( int eventCode );
+
+        // turns the listener in slot k into a tombstone
+        void removeSlot( int k );
+
+        // drops the tombstones from mOrder and frees their slots
+        void compact();
+
+        // puts a listener in the index, or the pending listeners once a dispatch is done
+        void insertIntoOrder( int slot, int eventCode );
+        void addPending();
+
+        // does the range or pattern listener at position pos of the index match eventCode?
+        boolean matches( int pos, int eventCode );
+
+        // the enabled bit of a slot
+        boolean isSlotEnabled( int slot );
+        void enableSlot( int slot, boolean enable );
+
+        // returns the slot of the listener with the given handle, or -1 if there is no such listener
+        int slotOf( ListenerHandle handle );
+
+        // adds a listener of any kind
+        ListenerHandle addItem( int eventCode, uint8_t match, int matchData, const Delegate& listener, int8_t priority );
+
+#if EVENTMANAGER_DIRECT_DISPATCH
+        static const int kFirstDirectCode = EVENTMANAGER_DIRECT_DISPATCH_FIRST;
+        static const int kNumDirectCodes = EVENTMANAGER_DIRECT_DISPATCH_LAST - EVENTMANAGER_DIRECT_DISPATCH_FIRST + 1;
+
+        static_assert( kNumDirectCodes > 0, "EVENTMANAGER_DIRECT_DISPATCH_LAST must not be less than EVENTMANAGER_DIRECT_DISPATCH_FIRST" );
+
+        // mDirect[ code - kFirstDirectCode ] is firstListener( code ) for each code in the range
+        uint8_t mDirect[ kNumDirectCodes ];
+
+        // brings mDirect up to date after mOrder changes
+        void updateDirectTable();
+#endif
+
+    };
+
+
+
+    // Storage for the listener list of a manager with MaxListeners listeners
+    // (specialized below to take no space for 0)
+    template< int MaxListeners >
+    class ListenerStorage
+    {
+
+    public:
+
+        Delegate* callbacks() { return mCallbacks; }
+        ListenerList::ListenerInfo* info() { return mInfo; }
+        uint8_t* enabled() { return mEnabled; }
+        uint8_t* order() { return mOrder; }
+        int* codes() { return mCodes; }
+
+    private:
+
+        Delegate                    mCallbacks[ MaxListeners ];
+        ListenerList::ListenerInfo  mInfo[ MaxListeners ];
+        int                         mCodes[ MaxListeners ];
+        uint8_t                     mOrder[ MaxListeners ];
+        uint8_t                     mEnabled[ ( MaxListeners + 7 ) / 8 ];
+    };
+
+};
+
+
+
+// A StaticDispatcher with at least one listener:  calls the first one if the event code
+// matches, then handles the rest of the list the same way
+template< int EventCode, EventManagerBase::EventListener Listener, class... Rest >
+class EventManagerBase::StaticDispatcher< EventManagerBase::On< EventCode, Listener >, Rest... >
+{
+
+public:
+
+    static int sendEvent( int eventCode, int param )
+    {
+        int handlerCount = 0;
+        if ( eventCode == EventCode )
+        {
+            Listener( eventCode, param );
+            handlerCount++;
+        }
+        return handlerCount + StaticDispatcher< Rest... >::sendEvent( eventCode, param );
+    }
+};
+
+
+// Listener storage for a manager that only uses a StaticDispatcher
+template<>
+class EventManagerBase::ListenerStorage< 0 >
+{
+
+public:
+
+    Delegate* callbacks() { return 0; }
+    ListenerList::ListenerInfo* info() { return 0; }
+    uint8_t* enabled() { return 0; }
+    uint8_t* order() { return 0; }
+    int* codes() { return 0; }
+};
+
+
+
+// Lock-free single-producer/single-consumer version of EventQueue.
+// The producer only ever writes the tail index and the consumer only ever writes
+// the head index, so neither side needs to suppress interrupts.  One slot is kept
+// empty to tell a full queue from an empty one.
+template< int Size >
+class EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree > : public QueueMonitor
+{
+
+public:
+
+    // Queue constructor
+    EventQueue();
+
+    // Returns true if no events are in the queue
+    boolean isEmpty();
+
+    // Returns true if no more events can be inserted into the queue
+    boolean isFull();
+
+    // Actual number of events in queue
+    int getNumEvents();
+
+    // Tries to insert an event into the queue;
+    // Returns true if successful, false if the queue if full and the event cannot be inserted
+    // Call only from the single producing context.
+    boolean queueEvent( int eventCode, int eventParam );
+
+    // The consumer may be reading any queued event, so a lock-free queue never
+    // coalesces events:  this simply queues the event
+    boolean queueEvent( int eventCode, int eventParam, CoalesceMode mode );
+
+    // Tries to insert numEvents events into the queue;  they are published together, so the
+    // consumer sees either none or all of them.  Returns the number inserted (in kAllOrNothing
+    // mode either all or none of them).  Call only from the single producing context.
+    int queueEvents( const Event* events, int numEvents, BatchMode mode );
+
+    // Tries to extract an event from the queue;
+    // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
+    // Call only from the single consuming context.
+    boolean popEvent( int* eventCode, int* eventParam );
+
+    // Extracts up to maxEvents events from the head of the queue into events[], oldest first;
+    // returns the number extracted
+    int popEvents( EventElement* events, int maxEvents );
+
+    // A lock-free queue can only reject new events when it is full:  returns true for
+    // kDropNewest only
+    boolean setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize );
+
+    // Only droppedNewest is ever counted.  resetOverflowStats() may miss an event
+    // dropped while it runs.
+    OverflowStats getOverflowStats();
+    void resetOverflowStats();
+
+private:
+
+    static const int kEventQueueSize = Size;
+
+    // One extra slot distinguishes a full queue from an empty one
+    static const int kNumSlots = kEventQueueSize + 1;
+
+#if defined( __AVR_ARCH__ )
+    // On AVR only single byte loads and stores are atomic
+    typedef uint8_t QueueIndex;
+    static_assert( kNumSlots <= 255, "Queue size must be less than 255 for the SPSC queue on AVR" );
+#else
+    typedef int QueueIndex;
+#endif
+
+    static QueueIndex nextIndex( QueueIndex i );
+
+    // The event queue
+    EventElement mEventQueue[ kNumSlots ];
+
+    // Index of event queue head; written only by the consumer
+    QueueIndex mEventQueueHead;
+
+    // Index of event queue tail; written only by the producer
+    QueueIndex mEventQueueTail;
+
+    // Written only by the producer (and by resetOverflowStats())
+    volatile unsigned int mDroppedNewest;
+};
+
+
+
+// Power of two sized version of EventQueue.
+// Head and tail are free-running counters: the queue holds tail - head events and
+// the slot for a counter value is found by masking off its low bits.  The counters
+// wrap around harmlessly because the size divides the range of the counter type.
+template< int Size, class LockPolicy >
+class EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > > : private LockPolicy, public QueueMonitor
+{
+
+public:
+
+    // Queue constructor
+    EventQueue();
+
+    // Returns true if no events are in the queue
+    boolean isEmpty();
+
+    // Returns true if no more events can be inserted into the queue
+    boolean isFull();
+
+    // Actual number of events in queue
+    int getNumEvents();
+
+    // Tries to insert an event into the queue;
+    // Returns true if successful, false if the queue if full and the event cannot be inserted
+    boolean queueEvent( int eventCode, int eventParam );
+
+    // Same as queueEvent( eventCode, eventParam ), except that if an event with the same code is
+    // already in the queue, eventParam is merged into the newest such event according to mode
+    boolean queueEvent( int eventCode, int eventParam, CoalesceMode mode );
+
+    // Tries to insert numEvents events into the queue, holding the lock only once;
+    // Returns the number inserted (in kAllOrNothing mode either all or none of them)
+    int queueEvents( const Event* events, int numEvents, BatchMode mode );
+
+    // Tries to extract an event from the queue;
+    // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
+    boolean popEvent( int* eventCode, int* eventParam );
+
+    // Extracts up to maxEvents events from the head of the queue into events[], oldest first,
+    // holding the lock only once for the whole run;  returns the number extracted
+    int popEvents( EventElement* events, int maxEvents );
+
+    // Overflow handling, as for the general EventQueue
+    boolean setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize );
+    OverflowStats getOverflowStats();
+    void resetOverflowStats();
+
+private:
+
+    // Stores an event at the tail, applying the overflow policy if the queue is full;
+    // call only with the lock held
+    boolean insertEvent( int eventCode, int eventParam );
+
+    // Moves spilled events back into the queue as far as there is room;  call only with the lock held
+    void refill();
+
+    static const int kEventQueueSize = Size;
+
+    static_assert( Size > 0 && ( Size & ( Size - 1 ) ) == 0, "Queue size must be a power of two for PowerOfTwoRing" );
+
+#if defined( __AVR_ARCH__ )
+    // A single byte counter is enough and keeps every access to it a single instruction
+    typedef uint8_t Counter;
+    static_assert( Size <= 128, "Queue size must be at most 128 for PowerOfTwoRing on AVR" );
+#else
+    typedef unsigned int Counter;
+#endif
+
+    static const Counter kIndexMask = kEventQueueSize - 1;
+
+    typedef typename LockPolicy::Guard Guard;
+
+    // The event queue
+    EventElement mEventQueue[ kEventQueueSize ];
+
+    // Free-running count of events popped
+    Counter mEventQueueHead;
+
+    // Free-running count of events queued
+    Counter mEventQueueTail;
+
+    uint8_t         mOverflowPolicy;
+    OverflowStats   mOverflowStats;
+    SpillBuffer     mSpill;
+};
+
+
+
+#if EVENTMANAGER_HAS_CAS
+
+// Lock-free multi-producer/single-consumer version of EventQueue.
+// Producers reserve a slot by advancing the enqueue position with an atomic
+// compare-and-swap, fill it in, and then publish it by updating the slot's sequence
+// number.  The single consumer waits for the sequence number of the head slot to
+// show that slot has been published.  There is no lock anywhere, so concurrent
+// producers never serialize on anything except the compare-and-swap itself.
+template< int Size >
+class EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree > : public QueueMonitor
+{
+
+public:
+
+    // Queue constructor
+    EventQueue();
+
+    // Returns true if no events are in the queue
+    boolean isEmpty();
+
+    // Returns true if no more events can be inserted into the queue
+    boolean isFull();
+
+    // Actual number of events in queue (including any still being inserted)
+    int getNumEvents();
+
+    // Tries to insert an event into the queue;
+    // Returns true if successful, false if the queue if full and the event cannot be inserted
+    boolean queueEvent( int eventCode, int eventParam );
+
+    // The consumer may be reading any queued event, so a lock-free queue never
+    // coalesces events:  this simply queues the event
+    boolean queueEvent( int eventCode, int eventParam, CoalesceMode mode );
+
+    // Tries to insert numEvents events into the queue;  space for all of them is reserved with
+    // a single compare-and-swap and they are published together, so the consumer sees either
+    // none or all of them.  Returns the number inserted (in kAllOrNothing mode either all or none).
+    int queueEvents( const Event* events, int numEvents, BatchMode mode );
+
+    // Tries to extract an event from the queue;
+    // Returns true if successful, false if the queue is empty (the parameteres are not touched in this case)
+    // An event whose producer has reserved a slot but not finished writing it is not yet visible.
+    // Call only from the single consuming context.
+    boolean popEvent( int* eventCode, int* eventParam );
+
+    // Extracts up to maxEvents events from the head of the queue into events[], oldest first;
+    // returns the number extracted
+    int popEvents( EventElement* events, int maxEvents );
+
+    // A lock-free queue can only reject new events when it is full:  returns true for
+    // kDropNewest only
+    boolean setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize );
+
+    // Only droppedNewest is ever counted.  resetOverflowStats() may miss an event
+    // dropped while it runs.
+    OverflowStats getOverflowStats();
+    void resetOverflowStats();
+
+private:
+
+    static const int kEventQueueSize = Size;
+    static const unsigned int kIndexMask = kEventQueueSize - 1;
+
+    static_assert( ( kEventQueueSize & ( kEventQueueSize - 1 ) ) == 0, "Queue size must be a power of two for the MPSC queue" );
+
+    // popEvent() for a whole event
+    boolean popElement( EventElement* event );
+
+    struct Slot
+    {
+        // Equals the enqueue position when the slot is free for that position,
+        // and the enqueue position + 1 once the event stored in it is published
+        unsigned int    sequence;
+        EventElement    event;
+    };
+
+    // The event queue
+    Slot mEventQueue[ kEventQueueSize ];
+
+    // Free-running position of the next slot to be reserved by a producer
+    unsigned int mEnqueuePos;
+
+    // Free-running position of the next slot to be popped; written only by the consumer
+    unsigned int mDequeuePos;
+
+    // Incremented atomically by the producers
+    unsigned int mDroppedNewest;
+};
+
+#endif
+
+
+
+// The event manager, parameterized by the lock policy used to protect its event queues
+// (see EventManagerBase::NoLock, InterruptMask, MutexLock, SpinLock, SpscLockFree and
+// MpscLockFree) and by its capacities:  the number of events the high priority queue and
+// each lower priority queue can hold, the number of listeners, and the number of priority
+// levels.  Each queue requires 2 * sizeof(int) bytes of RAM for each unit of size.  Most
+// code should simply use the EventManager type defined below (or SizedEventManager to
+// change only the capacities).
+template< class LockPolicy = EventManagerBase::DefaultLockPolicy,
+          int HiQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE,
+          int LoQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE,
+          int MaxListeners = EVENTMANAGER_LISTENER_LIST_SIZE,
+          int PriorityLevels = EVENTMANAGER_PRIORITY_LEVELS >
+class EventManagerT : public EventManagerBase
+{
+    static_assert( PriorityLevels >= 2 && PriorityLevels <= kMaxPriorityLevels, "EventManager supports 2 to 8 priority levels" );
+
+public:
+
+    // Create an event manager
+    // With the default lock policy it operates in interrupt safe mode, allowing you to queue events from interrupt handlers
+    EventManagerT();
+
+    // Add a listener
+    // Returns a handle for the listener if it is successfully installed, 0 otherwise (e.g. the dispatch table is full)
+    // The listener can be a plain EventListener function or any Delegate (e.g., a bound member function)
+    // Listeners for the same event code are called in order of decreasing priority (-128 to 127),
+    // and in the order they were added if their priorities are equal.  A consuming listener that
+    // returns true stops the event from being sent to the listeners after it.
+    ListenerHandle addListener( int eventCode, const Delegate& listener, int8_t priority = 0 );
+
+    // Add a listener that is passed context each time it is called
+    ListenerHandle addListener( int eventCode, ContextListener listener, void* context, int8_t priority = 0 );
+    ListenerHandle addListener( int eventCode, ConsumingContextListener listener, void* context, int8_t priority = 0 );
+
+    // Add a listener for every event code from firstCode to lastCode (inclusive), or for every
+    // code for which ( code & mask ) == value, using a single entry of the listener list
+    // These are removed with removeListener( listener ) or with their handle.  At equal
+    // priority, listeners added for a single event code are called before these.
+    // addMaskListener() returns 0 if value has bits set outside mask, since no code could match.
+    ListenerHandle addRangeListener( int firstCode, int lastCode, const Delegate& listener, int8_t priority = 0 );
+    ListenerHandle addMaskListener( int value, int mask, const Delegate& listener, int8_t priority = 0 );
+
+    // Remove (event, listener) pair (all occurrences)
+    // Other listeners with the same function or event code will not be affected
+    // (a ContextListener only matches if its context is the same too)
+    boolean removeListener( int eventCode, const Delegate& listener );
+
+    // Remove all occurrances of a listener
+    // Removes this listener regardless of the event code; returns number removed
+    // Useful when one listener handles many different events
+    int removeListener( const Delegate& listener );
+
+    // Remove, enable or disable the listener with the handle returned when it was added
+    // These take constant time, whatever the size of the listener list
+    // Return false if the listener has already been removed
+    boolean removeListener( ListenerHandle handle );
+    boolean enableListener( ListenerHandle handle, boolean enable );
+    boolean isListenerEnabled( ListenerHandle handle );
+
+    // Enable or disable a listener
+    // Return true if the listener was successfully enabled or disabled, false if the listener was not found
+    boolean enableListener( int eventCode, const Delegate& listener, boolean enable );
+
+    // Returns the current enabled/disabled state of the (eventCode, listener) combo
+    boolean isListenerEnabled( int eventCode, const Delegate& listener );
+
+    // The default listener is a callback function that is called when an event with no listener is processed
+    // These functions set, clear, and enable/disable the default listener
+    boolean setDefaultListener( EventListener listener );
+    void removeDefaultListener();
+    void enableDefaultListener( boolean enable );
+
+    // Is the ListenerList empty?
+    boolean isListenerListEmpty();
+
+    // Is the ListenerList full?
+    boolean isListenerListFull();
+
+    int numListeners();
+
+    // Returns true if no events are in the queue
+    boolean isEventQueueEmpty( EventPriority pri = kLowPriority );
+
+    // Returns true if no more events can be inserted into the queue
+    boolean isEventQueueFull( EventPriority pri = kLowPriority );
+
+    // Actual number of events in queue
+    int getNumEventsInQueue( EventPriority pri = kLowPriority );
+
+    // tries to insert an event into the queue;
+    // returns true if successful, false if the
+    // queue if full and the event cannot be inserted
+    // (an event that is coalesced into one already queued always succeeds, and what happens
+    // when the queue is full depends on its overflow policy)
+    boolean queueEvent( int eventCode, int eventParam, EventPriority pri = kLowPriority );
+
+    // Sets how queueEvent() coalesces events with this code (see EventManagerBase::CoalesceMode);
+    // kNoCoalescing turns coalescing off again.  Returns false if EVENTMANAGER_COALESCE_LIST_SIZE
+    // codes already have a mode.  Events queued with queueEvents() or into a lock-free queue
+    // are never coalesced.  Set modes before queueing events with these codes from interrupts.
+    boolean setCoalescing( int eventCode, CoalesceMode mode );
+
+    // Sets what queueEvent() does when the queue for priority pri is full (see
+    // EventManagerBase::OverflowPolicy).  kSpill needs a buffer of spillSize SpilledEvents that
+    // stays valid while the policy is in effect.  Returns false if the arguments are invalid,
+    // if spilled events are still waiting, or for any policy but kDropNewest on a lock-free queue.
+    boolean setOverflowPolicy( EventPriority pri, OverflowPolicy policy, SpilledEvent* spillBuffer = 0, int spillSize = 0 );
+
+    // Counts of the events affected by the overflow policy of the queue for priority pri
+    OverflowStats getOverflowStats( EventPriority pri = kLowPriority );
+    void resetOverflowStats( EventPriority pri = kLowPriority );
+
+#if EVENTMANAGER_QUEUE_STATS
+    // Statistics on the use of the queue for priority pri (see EventManagerBase::QueueStats).
+    // Can be called at any time, even from interrupt handlers, without holding up event
+    // processing;  each value is read atomically.
+    QueueStats getQueueStats( EventPriority pri = kLowPriority );
+    void resetQueueStats( EventPriority pri = kLowPriority );
+#endif
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+    // Starts a timer that queues the event ( eventCode, eventParam ) with priority pri once, delay
+    // ticks of EVENTMANAGER_TIMER_CLOCK (milliseconds by default) from now, or every period ticks.
+    // The events are queued by processEvent() and processAllEvents(), so a timer is late by as
+    // much as they are.  Returns a handle for cancelTimer(), or 0 if EVENTMANAGER_TIMER_LIST_SIZE
+    // timers are running already (or period is 0).  Call these from the context that processes events.
+    // With SpscLockFree that context becomes a producer of the queue for pri (see SpscLockFree).
+    TimerHandle startTimer( unsigned long delay, int eventCode, int eventParam = 0, EventPriority pri = kLowPriority );
+    TimerHandle startPeriodicTimer( unsigned long period, int eventCode, int eventParam = 0, EventPriority pri = kLowPriority );
+
+    // Stops a timer before it expires;  returns false if it is not running
+    boolean cancelTimer( TimerHandle handle );
+    boolean isTimerRunning( TimerHandle handle );
+
+    // Counts of the timer events that were late because their queue was full or because
+    // processing fell more than a period behind a periodic timer (see EventManagerBase::TimerStats)
+    TimerStats getTimerStats();
+    void resetTimerStats();
+#endif
+
+#if EVENTMANAGER_EVENT_LATENCY
+    // How long the events of priority pri waited in their queue (see EventManagerBase::LatencyStats
+    // and EventManagerBase::latencyPercentile()).  Only updated by processEvent() and
+    // processAllEvents(), so call these from the same context.
+    LatencyStats getLatencyStats( EventPriority pri = kLowPriority );
+    void resetLatencyStats( EventPriority pri = kLowPriority );
+#endif
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+    // Sets a time budget for listeners:  whenever a listener (or the default listener) takes
+    // longer than budgetMicros to handle an event, hook is called once it returns.  A budget of
+    // 0 turns the check off.
+    void setListenerBudget( unsigned long budgetMicros, OverrunHook hook );
+#endif
+
+#if EVENTMANAGER_LISTENER_PROFILING
+    // The number of calls and the total and longest time taken by the listener with the given
+    // handle (see EventManagerBase::ListenerProfile);  returns false if there is no such listener.
+    // The counts start when the listener is added, or when resetListenerProfiles() is called.
+    boolean getListenerProfile( ListenerHandle handle, ListenerProfile* profile );
+    void resetListenerProfiles();
+
+    // Prints a line for each listener:  its handle, event code(s), calls, total and longest time
+    void dumpListenerProfiles( Print& out = Serial );
+#endif
+
+    // tries to insert numEvents events into the queue at once, e.g. a burst from an interrupt handler;
+    // space for the whole batch is reserved once and the events are committed together.
+    // returns the number of events inserted: in kAllOrNothing mode either numEvents or 0,
+    // in kAcceptPartial mode as many as fit (the first ones in events[])
+    int queueEvents( const Event* events, int numEvents, EventPriority pri = kLowPriority, BatchMode mode = kAllOrNothing );
+
+    // this must be called regularly (usually by calling it inside the loop() function)
+    int processEvent();
+
+    // this function can be called to process ALL events in the queue
+    // WARNING:  if interrupts are adding events as fast as they are being processed
+    // this function might never return.  YOU HAVE BEEN WARNED.
+    int processAllEvents();
+
+    // Same as processEvent() and processAllEvents(), except that each event is first sent to
+    // the listeners of Dispatcher (an EventManagerBase::StaticDispatcher) and then to the
+    // listeners added with addListener().  The default listener is only called if neither has one.
+    template< class Dispatcher > int processEvent();
+    template< class Dispatcher > int processAllEvents();
+
+
+private:
+
+    static const int kBatchSize = EVENTMANAGER_BATCH_SIZE;
+
+    // Sends an event to the listeners of Dispatcher and then to those in mListeners
+    template< class Dispatcher > int sendEvent( int eventCode, int param );
+
+    static const uint8_t kAllLevels = ( 1 << PriorityLevels ) - 1;
+
+    // The level an event of priority pri is queued at
+    static int levelOf( EventPriority pri );
+
+    boolean isLevelEmpty( int level );
+
+    // Extracts up to maxEvents of the oldest events of the highest priority level in
+    // candidates that has any;  returns the number extracted and sets *level to their level
+    int popHighest( EventElement* events, int maxEvents, uint8_t candidates, int* level );
+
+#if EVENTMANAGER_EVENT_LATENCY
+    // Adds the time event has waited to the latency statistics of level
+    void recordLatency( int level, const EventElement& event );
+
+    LatencyStats    mLatencyStats[ PriorityLevels ];
+#else
+    void recordLatency( int, const EventElement& ) {}
+#endif
+
+    // Level 0 is the high priority queue, levels 1 and up the lower priority queues
+    EventQueue< HiQueueSize, LockPolicy > 	mHighPriorityQueue;
+    EventQueue< LoQueueSize, LockPolicy > 	mLowerPriorityQueues[ PriorityLevels - 1 ];
+
+    ReadyLevels< PriorityLevels >   mReadyLevels;
+
+    CoalesceRules   mCoalesceRules;
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+    // Queues the events of the timers that have expired
+    void queueExpiredTimers();
+
+    TimerWheel      mTimers;
+#else
+    void queueExpiredTimers() {}
+#endif
+
+    // Storage for the listener list; the list itself is not a template, so managers
+    // of different sizes share one copy of its code
+    // (none at all if MaxListeners is 0, for a manager that only uses a StaticDispatcher)
+    ListenerStorage< MaxListeners >     mListenerStorage;
+    ListenerList		mListeners;
+
+    static_assert( MaxListeners >= 0 && MaxListeners <= 255, "EventManager supports 0 to 255 listeners" );
+    static_assert( MaxListeners == 0 ||
+                   sizeof( ListenerStorage< MaxListeners > ) < MaxListeners * ListenerList::kBytesPerListener + ( MaxListeners + 7 ) / 8 + alignof( ListenerStorage< MaxListeners > ),
+                   "ListenerList::kBytesPerListener must account for all the listener arrays" );
+};
+
+
+// The standard event manager, using the default lock policy and capacities
+typedef EventManagerT<> EventManager;
+
+// An event manager with the given capacities, e.g. a small high priority queue and a large
+// low priority queue:  SizedEventManager< 4, 32, 16 > gMyEventManager;
+// or four priority levels:  SizedEventManager< 4, 16, 16, EventManager::DefaultLockPolicy, 4 >
+template< int HiQueueSize, int LoQueueSize, int MaxListeners, class LockPolicy = EventManagerBase::DefaultLockPolicy,
+          int PriorityLevels = EVENTMANAGER_PRIORITY_LEVELS >
+using SizedEventManager = EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >;
+
+
+
+//*********  INLINES   EventManagerT::  ***********
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::EventManagerT() :
+mListeners( mListenerStorage.callbacks(), mListenerStorage.info(), mListenerStorage.enabled(),
+            mListenerStorage.order(), mListenerStorage.codes(), MaxListeners )
+{
+#if EVENTMANAGER_EVENT_LATENCY
+    for ( int level = 0; level < PriorityLevels; level++ )
+    {
+        mLatencyStats[ level ] = LatencyStats();
+    }
+#endif
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::ListenerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::addListener( int eventCode, const Delegate& listener, int8_t priority )
+{
+    return mListeners.addListener( eventCode, listener, priority );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::ListenerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::addListener( int eventCode, ContextListener listener, void* context, int8_t priority )
+{
+    return mListeners.addListener( eventCode, Delegate( listener, context ), priority );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::ListenerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::addListener( int eventCode, ConsumingContextListener listener, void* context, int8_t priority )
+{
+    return mListeners.addListener( eventCode, Delegate( listener, context ), priority );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::ListenerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::addRangeListener( int firstCode, int lastCode, const Delegate& listener, int8_t priority )
+{
+    return mListeners.addRangeListener( firstCode, lastCode, listener, priority );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::ListenerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::addMaskListener( int value, int mask, const Delegate& listener, int8_t priority )
+{
+    return mListeners.addMaskListener( value, mask, listener, priority );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::removeListener( int eventCode, const Delegate& listener )
+{
+    return mListeners.removeListener( eventCode, listener );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::removeListener( const Delegate& listener )
+{
+    return mListeners.removeListener( listener );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::removeListener( ListenerHandle handle )
+{
+    return mListeners.removeListener( handle );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::enableListener( ListenerHandle handle, boolean enable )
+{
+    return mListeners.enableListener( handle, enable );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isListenerEnabled( ListenerHandle handle )
+{
+    return mListeners.isListenerEnabled( handle );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::enableListener( int eventCode, const Delegate& listener, boolean enable )
+{
+    return mListeners.enableListener( eventCode, listener, enable );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isListenerEnabled( int eventCode, const Delegate& listener )
+{
+    return mListeners.isListenerEnabled( eventCode, listener );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::setDefaultListener( EventListener listener )
+{
+    return mListeners.setDefaultListener( listener );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::removeDefaultListener()
+{
+    mListeners.removeDefaultListener();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::enableDefaultListener( boolean enable )
+{
+    mListeners.enableDefaultListener( enable );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isListenerListEmpty()
+{
+    return mListeners.isEmpty();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isListenerListFull()
+{
+    return mListeners.isFull();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::numListeners()
+{
+    return mListeners.numListeners();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isEventQueueEmpty( EventPriority pri )
+{
+    return isLevelEmpty( levelOf( pri ) );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isEventQueueFull( EventPriority pri )
+{
+    int level = levelOf( pri );
+    return level ? mLowerPriorityQueues[ level - 1 ].isFull() : mHighPriorityQueue.isFull();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getNumEventsInQueue( EventPriority pri )
+{
+    int level = levelOf( pri );
+    return level ? mLowerPriorityQueues[ level - 1 ].getNumEvents() : mHighPriorityQueue.getNumEvents();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean ISR_ATTR EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::queueEvent( int eventCode, int eventParam, EventPriority pri )
+{
+    int level = levelOf( pri );
+    CoalesceMode coalesce = mCoalesceRules.find( eventCode );
+    boolean queued = level ?
+        mLowerPriorityQueues[ level - 1 ].queueEvent( eventCode, eventParam, coalesce ) : mHighPriorityQueue.queueEvent( eventCode, eventParam, coalesce );
+    if ( queued )
+    {
+        mReadyLevels.set( level );
+    }
+    return queued;
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::setCoalescing( int eventCode, CoalesceMode mode )
+{
+    return mCoalesceRules.set( eventCode, mode );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::setOverflowPolicy( EventPriority pri, OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize )
+{
+    int level = levelOf( pri );
+    return level ?
+        mLowerPriorityQueues[ level - 1 ].setOverflowPolicy( policy, spillBuffer, spillSize ) :
+        mHighPriorityQueue.setOverflowPolicy( policy, spillBuffer, spillSize );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::OverflowStats EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getOverflowStats( EventPriority pri )
+{
+    int level = levelOf( pri );
+    return level ? mLowerPriorityQueues[ level - 1 ].getOverflowStats() : mHighPriorityQueue.getOverflowStats();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::resetOverflowStats( EventPriority pri )
+{
+    int level = levelOf( pri );
+    if ( level )
+    {
+        mLowerPriorityQueues[ level - 1 ].resetOverflowStats();
+    }
+    else
+    {
+        mHighPriorityQueue.resetOverflowStats();
+    }
+}
+
+#if EVENTMANAGER_QUEUE_STATS
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::QueueStats EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getQueueStats( EventPriority pri )
+{
+    int level = levelOf( pri );
+    return level ? mLowerPriorityQueues[ level - 1 ].getQueueStats() : mHighPriorityQueue.getQueueStats();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::resetQueueStats( EventPriority pri )
+{
+    int level = levelOf( pri );
+    if ( level )
+    {
+        mLowerPriorityQueues[ level - 1 ].resetQueueStats();
+    }
+    else
+    {
+        mHighPriorityQueue.resetQueueStats();
+    }
+}
+
+#endif
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::TimerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::startTimer( unsigned long delay, int eventCode, int eventParam, EventPriority pri )
+{
+    return mTimers.start( EVENTMANAGER_TIMER_CLOCK(), delay, 0, eventCode, eventParam, pri );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::TimerHandle EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::startPeriodicTimer( unsigned long period, int eventCode, int eventParam, EventPriority pri )
+{
+    return period ? mTimers.start( EVENTMANAGER_TIMER_CLOCK(), period, period, eventCode, eventParam, pri ) : 0;
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::cancelTimer( TimerHandle handle )
+{
+    return mTimers.cancel( handle );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isTimerRunning( TimerHandle handle )
+{
+    return mTimers.isRunning( handle );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::queueExpiredTimers()
+{
+    unsigned long now = EVENTMANAGER_TIMER_CLOCK();
+    Event event;
+    EventPriority pri;
+    while ( mTimers.peekExpired( now, &event, &pri ) )
+    {
+        if ( !queueEvent( event.code, event.param, pri ) )
+        {
+            // The queue is full:  leave this timer (and those after it) expired, and try
+            // again on the next call, once processing has made room
+            mTimers.deferExpired();
+            return;
+        }
+        mTimers.popExpired( now );
+    }
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::TimerStats EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getTimerStats()
+{
+    return mTimers.getStats();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::resetTimerStats()
+{
+    mTimers.resetStats();
+}
+
+#endif
+
+#if EVENTMANAGER_EVENT_LATENCY
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline EventManagerBase::LatencyStats EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getLatencyStats( EventPriority pri )
+{
+    return mLatencyStats[ levelOf( pri ) ];
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::resetLatencyStats( EventPriority pri )
+{
+    mLatencyStats[ levelOf( pri ) ] = LatencyStats();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::recordLatency( int level, const EventElement& event )
+{
+    unsigned long latency = EVENTMANAGER_LATENCY_CLOCK() - event.queuedAt;
+    LatencyStats& stats = mLatencyStats[ level ];
+
+    if ( !stats.events || latency < stats.minLatency )
+    {
+        stats.minLatency = latency;
+    }
+    if ( latency > stats.maxLatency )
+    {
+        stats.maxLatency = latency;
+    }
+    stats.events++;
+    stats.totalLatency += latency;
+
+    int bin = 0;
+    while ( latency > 1 && bin < kNumLatencyBins - 1 )
+    {
+        latency >>= 1;
+        bin++;
+    }
+    stats.latency[ bin ]++;
+}
+
+#endif
+
+#if EVENTMANAGER_LISTENER_WATCHDOG
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::setListenerBudget( unsigned long budgetMicros, OverrunHook hook )
+{
+    mListeners.setListenerBudget( budgetMicros, hook );
+}
+
+#endif
+
+#if EVENTMANAGER_LISTENER_PROFILING
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::getListenerProfile( ListenerHandle handle, ListenerProfile* profile )
+{
+    return mListeners.getListenerProfile( handle, profile );
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::resetListenerProfiles()
+{
+    mListeners.resetListenerProfiles();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline void EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::dumpListenerProfiles( Print& out )
+{
+    mListeners.dumpListenerProfiles( out );
+}
+
+#endif
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int ISR_ATTR EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::queueEvents( const Event* events, int numEvents, EventPriority pri, BatchMode mode )
+{
+    int level = levelOf( pri );
+    int n = level ?
+        mLowerPriorityQueues[ level - 1 ].queueEvents( events, numEvents, mode ) : mHighPriorityQueue.queueEvents( events, numEvents, mode );
+    if ( n )
+    {
+        mReadyLevels.set( level );
+    }
+    return n;
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::processEvent()
+{
+    return processEvent< StaticDispatcher<> >();
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::processAllEvents()
+{
+    return processAllEvents< StaticDispatcher<> >();
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+template< class Dispatcher >
+inline int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::sendEvent( int eventCode, int param )
+{
+    int handledCount = Dispatcher::sendEvent( eventCode, param );
+    return handledCount + mListeners.sendEvent( eventCode, param, handledCount != 0 );
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+template< class Dispatcher >
+int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::processEvent()
+{
+    EventElement event = EventElement();
+    int level;
+    int handledCount = 0;
+
+    queueExpiredTimers();
+
+    // Handle the oldest event of the highest priority level.  If nobody handles it (no
+    // listeners for it), then try the next lower priority level that has events, and so on
+    uint8_t candidates = kAllLevels;
+    while ( !handledCount && popHighest( &event, 1, candidates, &level ) )
+    {
+        recordLatency( level, event );
+        handledCount = sendEvent< Dispatcher >( event.code, event.param );
+
+        EVTMGR_DEBUG_PRINT( "processEvent() level " )
+        EVTMGR_DEBUG_PRINT( level )
+        EVTMGR_DEBUG_PRINT( " event " )
+        EVTMGR_DEBUG_PRINT( event.code )
+        EVTMGR_DEBUG_PRINT( ", " )
+        EVTMGR_DEBUG_PRINT( event.param )
+        EVTMGR_DEBUG_PRINT( " sent to " )
+        EVTMGR_DEBUG_PRINTLN( handledCount )
+
+        // Only the levels below this one
+        candidates &= ~( ( 2 << level ) - 1 );
+    }
+
+    return handledCount;
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+template< class Dispatcher >
+int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::processAllEvents()
+{
+    // Events are copied out of the queues a batch at a time and then dispatched, so
+    // the queue lock is taken once per batch rather than once per event
+    EventElement batch[ kBatchSize ];
+    int level;
+    int handledCount = 0;
+
+    queueExpiredTimers();
+
+    // Each batch comes from the highest priority level that has events, including
+    // any queued while the previous batch was being dispatched.  A batch is always
+    // dispatched to the end, so such events wait until it is finished.
+    int n;
+    while ( ( n = popHighest( batch, kBatchSize, kAllLevels, &level ) ) != 0 )
+    {
+        for ( int i = 0; i < n; i++ )
+        {
+            recordLatency( level, batch[i] );
+            handledCount += sendEvent< Dispatcher >( batch[i].code, batch[i].param );
+
+            EVTMGR_DEBUG_PRINT( "processAllEvents() event " )
+            EVTMGR_DEBUG_PRINT( batch[i].code )
+            EVTMGR_DEBUG_PRINT( ", " )
+            EVTMGR_DEBUG_PRINT( batch[i].param )
+            EVTMGR_DEBUG_PRINT( " sent to " )
+            EVTMGR_DEBUG_PRINTLN( handledCount )
+        }
+    }
+
+    return handledCount;
+}
+
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline int ISR_ATTR EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::levelOf( EventPriority pri )
+{
+    return ( pri < PriorityLevels ) ? pri : PriorityLevels - 1;
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+inline boolean EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::isLevelEmpty( int level )
+{
+    return level ? mLowerPriorityQueues[ level - 1 ].isEmpty() : mHighPriorityQueue.isEmpty();
+}
+
+template< class LockPolicy, int HiQueueSize, int LoQueueSize, int MaxListeners, int PriorityLevels >
+int EventManagerT< LockPolicy, HiQueueSize, LoQueueSize, MaxListeners, PriorityLevels >::popHighest( EventElement* events, int maxEvents, uint8_t candidates, int* level )
+{
+    uint8_t ready;
+    while ( ( ready = mReadyLevels.get() & candidates ) != 0 )
+    {
+        int top = ReadyLevels< PriorityLevels >::highest( ready );
+        int n = top ?
+            mLowerPriorityQueues[ top - 1 ].popEvents( events, maxEvents ) : mHighPriorityQueue.popEvents( events, maxEvents );
+
+        if ( isLevelEmpty( top ) )
+        {
+            // An event may be queued at this level between the check and clearing the bit,
+            // so check again once it is cleared
+            mReadyLevels.clear( top );
+            if ( !isLevelEmpty( top ) )
+            {
+                mReadyLevels.set( top );
+            }
+        }
+
+        if ( n )
+        {
+            *level = top;
+            return n;
+        }
+
+        // Nothing to pop although the level is not empty:  a producer has reserved the slot at
+        // the head of a lock-free queue but not yet filled it.  Its bit stays set (the event is
+        // coming), but look at the lower levels this time rather than spin on this one.
+        candidates &= ~( 1 << top );
+    }
+
+    return 0;
+}
+
+
+
+//*********  INLINES   EventManagerBase::  ***********
+
+inline int ISR_ATTR EventManagerBase::batchCount( int numEvents, int room, BatchMode mode )
+{
+    if ( numEvents <= 0 )
+    {
+        return 0;
+    }
+    if ( numEvents <= room )
+    {
+        return numEvents;
+    }
+    return ( mode == kAcceptPartial ) ? room : 0;
+}
+
+inline void ISR_ATTR EventManagerBase::coalesce( int* pendingParam, int eventParam, CoalesceMode mode )
+{
+    switch ( mode )
+    {
+        case kCoalesceSum:
+            *pendingParam += eventParam;
+            break;
+
+        case kCoalesceOr:
+            *pendingParam |= eventParam;
+            break;
+
+        default:
+            *pendingParam = eventParam;
+            break;
+    }
+}
+
+
+
+template< class T >
+inline T ISR_ATTR EventManagerBase::loadShared( const T& counter )
+{
+#if defined( __AVR_ARCH__ )
+    // Single core, and no atomic 16-bit loads:  a volatile read, as before
+    return *static_cast< const volatile T* >( &counter );
+#else
+    return __atomic_load_n( &counter, __ATOMIC_ACQUIRE );
+#endif
+}
+
+template< class T >
+inline void ISR_ATTR EventManagerBase::storeShared( T& counter, T value )
+{
+#if defined( __AVR_ARCH__ )
+    *static_cast< volatile T* >( &counter ) = value;
+#else
+    __atomic_store_n( &counter, value, __ATOMIC_RELEASE );
+#endif
+}
+
+#if EVENTMANAGER_EVENT_LATENCY
+
+inline void ISR_ATTR EventManagerBase::stampQueued( EventElement* event )
+{
+    event->queuedAt = EVENTMANAGER_LATENCY_CLOCK();
+}
+
+#endif
+
+
+
+#if EVENTMANAGER_QUEUE_STATS
+
+//*********  INLINES   EventManagerBase::QueueMonitor::  ***********
+
+inline int EventManagerBase::QueueMonitor::occupancyBin( int occupancy )
+{
+    int bin = 0;
+    while ( occupancy > 1 && bin < kNumOccupancyBins - 1 )
+    {
+        occupancy >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+#if EVENTMANAGER_HAS_ATOMIC_RMW
+
+inline void ISR_ATTR EventManagerBase::QueueMonitor::add( volatile unsigned long* counter, unsigned long n )
+{
+    __atomic_fetch_add( counter, n, __ATOMIC_RELAXED );
+}
+
+inline void ISR_ATTR EventManagerBase::QueueMonitor::recordQueued( int numEvents, int occupancy )
+{
+    add( &mQueued, numEvents );
+    add( &mOccupancy[ occupancyBin( occupancy ) ], 1 );
+
+    int highWaterMark = __atomic_load_n( &mHighWaterMark, __ATOMIC_RELAXED );
+    while ( occupancy > highWaterMark )
+    {
+        // On failure highWaterMark is reloaded with the current value
+        if ( __atomic_compare_exchange_n( &mHighWaterMark, &highWaterMark, occupancy, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            break;
+        }
+    }
+}
+
+#else
+
+inline void ISR_ATTR EventManagerBase::QueueMonitor::add( volatile unsigned long* counter, unsigned long n )
+{
+    InterruptMask::Guard guard( mLock );
+    *counter += n;
+}
+
+inline void ISR_ATTR EventManagerBase::QueueMonitor::recordQueued( int numEvents, int occupancy )
+{
+    InterruptMask::Guard guard( mLock );
+    mQueued += numEvents;
+    mOccupancy[ occupancyBin( occupancy ) ]++;
+    if ( occupancy > mHighWaterMark )
+    {
+        mHighWaterMark = occupancy;
+    }
+}
+
+#endif
+
+inline void ISR_ATTR EventManagerBase::QueueMonitor::recordDropped( int numEvents )
+{
+    add( &mDropped, numEvents );
+}
+
+#endif
+
+
+
+//*********  INLINES   EventManagerBase::SpillBuffer::  ***********
+
+inline EventManagerBase::SpillBuffer::SpillBuffer() :
+mEvents( 0 ), mSize( 0 ), mHead( 0 ), mNumEvents( 0 )
+{
+}
+
+inline void EventManagerBase::SpillBuffer::setStorage( SpilledEvent* events, int size )
+{
+    mEvents = events;
+    mSize = events ? size : 0;
+    mHead = 0;
+    storeShared( mNumEvents, 0 );
+}
+
+inline boolean ISR_ATTR EventManagerBase::SpillBuffer::isEmpty()
+{
+    return ( loadShared( mNumEvents ) == 0 );
+}
+
+inline int ISR_ATTR EventManagerBase::SpillBuffer::getNumEvents()
+{
+    return loadShared( mNumEvents );
+}
+
+inline boolean ISR_ATTR EventManagerBase::SpillBuffer::push( int eventCode, int eventParam )
+{
+    if ( mNumEvents == mSize )
+    {
+        return false;
+    }
+
+    // Avoids a division (costly on AVR) compared to ( mHead + mNumEvents ) % mSize
+    int tail = mHead + mNumEvents;
+    if ( tail >= mSize )
+    {
+        tail -= mSize;
+    }
+    mEvents[ tail ].code = eventCode;
+    mEvents[ tail ].param = eventParam;
+#if EVENTMANAGER_EVENT_LATENCY
+    mEvents[ tail ].queuedAt = EVENTMANAGER_LATENCY_CLOCK();
+#endif
+    storeShared( mNumEvents, mNumEvents + 1 );
+
+    return true;
+}
+
+inline boolean EventManagerBase::SpillBuffer::pop( EventElement* event )
+{
+    if ( mNumEvents == 0 )
+    {
+        return false;
+    }
+
+    event->code = mEvents[ mHead ].code;
+    event->param = mEvents[ mHead ].param;
+#if EVENTMANAGER_EVENT_LATENCY
+    event->queuedAt = mEvents[ mHead ].queuedAt;
+#endif
+    if ( ++mHead == mSize )
+    {
+        mHead = 0;
+    }
+    storeShared( mNumEvents, mNumEvents - 1 );
+
+    return true;
+}
+
+inline EventManagerBase::SpilledEvent* ISR_ATTR EventManagerBase::SpillBuffer::findNewest( int eventCode )
+{
+    for ( int k = mNumEvents - 1; k >= 0; k-- )
+    {
+        int i = mHead + k;
+        if ( i >= mSize )
+        {
+            i -= mSize;
+        }
+        if ( mEvents[i].code == eventCode )
+        {
+            return &mEvents[i];
+        }
+    }
+    return 0;
+}
+
+
+
+//*********  INLINES   EventManagerBase::CoalesceRules::  ***********
+
+inline EventManagerBase::CoalesceMode ISR_ATTR EventManagerBase::CoalesceRules::find( int eventCode )
+{
+    for ( int i = 0; i < kNumRules; i++ )
+    {
+        if ( mRules[i].mode != kNoCoalescing && mRules[i].eventCode == eventCode )
+        {
+            return static_cast<CoalesceMode>( mRules[i].mode );
+        }
+    }
+    return kNoCoalescing;
+}
+
+
+
+#if EVENTMANAGER_TIMER_LIST_SIZE
+
+//*********  INLINES   EventManagerBase::TimerWheel::  ***********
+
+inline boolean EventManagerBase::TimerWheel::isRunning( TimerHandle handle )
+{
+    return timerOf( handle ) >= 0;
+}
+
+inline uint8_t& EventManagerBase::TimerWheel::head( int slot )
+{
+    return ( slot == kExpired ) ? mExpired : mSlots[ slot ];
+}
+
+inline void EventManagerBase::TimerWheel::deferExpired()
+{
+    mStats.deferred++;
+}
+
+inline EventManagerBase::TimerStats EventManagerBase::TimerWheel::getStats()
+{
+    return mStats;
+}
+
+inline void EventManagerBase::TimerWheel::resetStats()
+{
+    mStats.deferred = 0;
+    mStats.skipped = 0;
+}
+
+#endif
+
+
+
+//*********  INLINES   EventManagerBase::ReadyLevels::  ***********
+
+#if EVENTMANAGER_HAS_ATOMIC_RMW
+
+template< int Levels >
+inline EventManagerBase::ReadyLevels< Levels >::ReadyLevels() :
+mBits( 0 )
+{
+}
+
+template< int Levels >
+inline uint8_t EventManagerBase::ReadyLevels< Levels >::get()
+{
+    return __atomic_load_n( &mBits, __ATOMIC_ACQUIRE );
+}
+
+template< int Levels >
+inline void ISR_ATTR EventManagerBase::ReadyLevels< Levels >::set( int level )
+{
+    __atomic_fetch_or( &mBits, (uint8_t) ( 1 << level ), __ATOMIC_ACQ_REL );
+}
+
+template< int Levels >
+inline void EventManagerBase::ReadyLevels< Levels >::clear( int level )
+{
+    __atomic_fetch_and( &mBits, (uint8_t) ~( 1 << level ), __ATOMIC_ACQ_REL );
+}
+
+#else
+
+template< int Levels >
+inline EventManagerBase::ReadyLevels< Levels >::ReadyLevels()
+{
+    for ( int level = 0; level < Levels; level++ )
+    {
+        mReady[ level ] = 0;
+    }
+}
+
+template< int Levels >
+inline uint8_t EventManagerBase::ReadyLevels< Levels >::get()
+{
+    uint8_t bits = 0;
+    for ( int level = 0; level < Levels; level++ )
+    {
+        if ( mReady[ level ] )
+        {
+            bits |= ( 1 << level );
+        }
+    }
+    return bits;
+}
+
+template< int Levels >
+inline void ISR_ATTR EventManagerBase::ReadyLevels< Levels >::set( int level )
+{
+    mReady[ level ] = 1;
+}
+
+template< int Levels >
+inline void EventManagerBase::ReadyLevels< Levels >::clear( int level )
+{
+    mReady[ level ] = 0;
+}
+
+#endif
+
+template< int Levels >
+inline int EventManagerBase::ReadyLevels< Levels >::highest( uint8_t bits )
+{
+#if defined( __AVR_ARCH__ ) || defined( __ARM_ARCH_6M__ )
+    // No count-trailing-zeros instruction, so narrow it down a nibble, a pair, and a bit at a time
+    int level = 0;
+    if ( !( bits & 0x0F ) )
+    {
+        bits >>= 4;
+        level += 4;
+    }
+    if ( !( bits & 0x03 ) )
+    {
+        bits >>= 2;
+        level += 2;
+    }
+    if ( !( bits & 0x01 ) )
+    {
+        level += 1;
+    }
+    return level;
+#else
+    return __builtin_ctz( bits );
+#endif
+}
+
+
+
+//*********  INLINES   EventManagerBase::EventQueue::  ***********
+
+template< int Size, class LockPolicy >
+EventManagerBase::EventQueue< Size, LockPolicy >::EventQueue() :
+mEventQueueHead( 0 ),
+mEventQueueTail( 0 ),
+mNumEvents( 0 ),
+mOverflowPolicy( kDropNewest ),
+mOverflowStats()
+{
+    for ( int i = 0; i < kEventQueueSize; i++ )
+    {
+        mEventQueue[i].code = EventManagerBase::kEventNone;
+        mEventQueue[i].param = 0;
+    }
+}
+
+
+template< int Size, class LockPolicy >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::isEmpty()
+{
+    return ( loadShared( mNumEvents ) == 0 );
+}
+
+
+template< int Size, class LockPolicy >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::isFull()
+{
+    return ( loadShared( mNumEvents ) == kEventQueueSize );
+}
+
+
+template< int Size, class LockPolicy >
+inline int ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::getNumEvents()
+{
+    // Any spilled events are waiting too
+    return loadShared( mNumEvents ) + mSpill.getNumEvents();
+}
+
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::queueEvent( int eventCode, int eventParam )
+{
+    /*
+    * The lock MUST be taken BEFORE the full queue check.
+    *
+    * If the call to isFull() returns FALSE but an asynchronous interrupt queues
+    * an event, making the queue full, before we finish inserting here, we will then
+    * corrupt the queue (we'll add an event to an already full queue). So the entire
+    * operation, from the call to isFull() to completing the inserting (if not full)
+    * must be atomic.
+    *
+    * Note that this race condition can only arise IF both interrupt and non-interrupt (normal)
+    * code add events to the queue.  If only normal code adds events, this can't happen
+    * because then there are no asynchronous additions to the queue.  If only interrupt
+    * handlers add events to the queue, this can't happen because further interrupts are
+    * blocked while an interrupt handler is executing.  This race condition can only happen
+    * when an event is added to the queue by normal (non-interrupt) code and simultaneously
+    * an interrupt handler tries to add an event to the queue.  This is the case that the
+    * InterruptMask lock policy (cli() = noInterrupts() on AVR) protects against.
+    *
+    * Contrast this with the logic in popEvent().
+    *
+    */
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // ATOMIC BLOCK BEGIN
+    boolean retVal = insertEvent( eventCode, eventParam );
+    // ATOMIC BLOCK END
+
+    return retVal;
+}
+
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::queueEvent( int eventCode, int eventParam, CoalesceMode mode )
+{
+    if ( mode == kNoCoalescing )
+    {
+        return queueEvent( eventCode, eventParam );
+    }
+
+    // As in queueEvent(), the lock MUST be taken BEFORE searching the queue, and the
+    // event must be inserted under the same lock if no match is found
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // Search from the newest event back, starting with any spilled events
+    SpilledEvent* spilled = mSpill.findNewest( eventCode );
+    if ( spilled )
+    {
+        coalesce( &spilled->param, eventParam, mode );
+        return true;
+    }
+
+    int i = mEventQueueTail;
+    for ( int k = 0; k < mNumEvents; k++ )
+    {
+        i = ( i ? i : kEventQueueSize ) - 1;
+        if ( mEventQueue[i].code == eventCode )
+        {
+            coalesce( &mEventQueue[i].param, eventParam, mode );
+            return true;
+        }
+    }
+
+    return insertEvent( eventCode, eventParam );
+}
+
+
+template< int Size, class LockPolicy >
+int ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::queueEvents( const Event* events, int numEvents, BatchMode mode )
+{
+    // As in queueEvent(), the lock MUST be taken BEFORE checking for room
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // The overflow policy does not apply to batches:  events that don't fit are rejected
+    int n = batchCount( numEvents, kEventQueueSize - mNumEvents, mode );
+    for ( int i = 0; i < n; i++ )
+    {
+        mEventQueue[ mEventQueueTail ].code = events[i].code;
+        mEventQueue[ mEventQueueTail ].param = events[i].param;
+        stampQueued( &mEventQueue[ mEventQueueTail ] );
+
+        mEventQueueTail = ( mEventQueueTail + 1 ) % kEventQueueSize;
+    }
+    storeShared( mNumEvents, mNumEvents + n );
+
+    if ( n )
+    {
+        recordQueued( n, mNumEvents );
+    }
+    if ( n < numEvents )
+    {
+        mOverflowStats.droppedNewest += numEvents - n;
+        recordDropped( numEvents - n );
+    }
+
+    return n;
+}
+
+
+template< int Size, class LockPolicy >
+boolean EventManagerBase::EventQueue< Size, LockPolicy >::popEvent( int* eventCode, int* eventParam )
+{
+    /*
+    * The lock MUST be taken AFTER the empty queue check.
+    *
+    * There is no harm if the isEmpty() call returns an "incorrect" TRUE response because
+    * an asynchronous interrupt queued an event after isEmpty() was called but before the
+    * return is executed.  We'll pick up that asynchronously queued event the next time
+    * popEvent() is called.
+    *
+    * If interrupts are suppressed before the isEmpty() check, we pretty much lock-up the Arduino.
+    * This is because popEvent(), via processEvents(), is normally called inside loop(), which
+    * means it is called VERY OFTEN.  Most of the time (>99%), the event queue will be empty.
+    * But that means that we'll have interrupts turned off for a significant fraction of the
+    * time.  We don't want to do that.  We only want interrupts turned off when we are
+    * actually manipulating the queue.
+    *
+    * Contrast this with the logic in queueEvent().
+    *
+    */
+
+    if ( isEmpty() )
+    {
+        return false;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // Pop the event from the head of the queue
+    // Store event code and event parameter into the user-supplied variables
+    *eventCode  = mEventQueue[ mEventQueueHead ].code;
+    *eventParam = mEventQueue[ mEventQueueHead ].param;
+
+    // Clear the event (paranoia)
+    mEventQueue[ mEventQueueHead ].code = EventManagerBase::kEventNone;
+
+    // Update the queue head value
+    mEventQueueHead = ( mEventQueueHead + 1 ) % kEventQueueSize;
+
+    // Update number of events in queue
+    storeShared( mNumEvents, mNumEvents - 1 );
+
+    refill();
+
+    return true;
+}
+
+
+template< int Size, class LockPolicy >
+int EventManagerBase::EventQueue< Size, LockPolicy >::popEvents( EventElement* events, int maxEvents )
+{
+    // Same logic as popEvent(), but the whole run is copied out under one lock
+    if ( isEmpty() )
+    {
+        return 0;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    int n = ( mNumEvents < maxEvents ) ? mNumEvents : maxEvents;
+    for ( int i = 0; i < n; i++ )
+    {
+        events[i] = mEventQueue[ mEventQueueHead ];
+
+        // Clear the event (paranoia)
+        mEventQueue[ mEventQueueHead ].code = EventManagerBase::kEventNone;
+
+        mEventQueueHead = ( mEventQueueHead + 1 ) % kEventQueueSize;
+    }
+    storeShared( mNumEvents, mNumEvents - n );
+
+    refill();
+
+    return n;
+}
+
+
+template< int Size, class LockPolicy >
+boolean EventManagerBase::EventQueue< Size, LockPolicy >::setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize )
+{
+    if ( policy == kSpill && ( !spillBuffer || spillSize <= 0 ) )
+    {
+        return false;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    if ( !mSpill.isEmpty() )
+    {
+        return false;
+    }
+
+    mOverflowPolicy = policy;
+    if ( policy == kSpill )
+    {
+        mSpill.setStorage( spillBuffer, spillSize );
+    }
+    else
+    {
+        mSpill.setStorage( 0, 0 );
+    }
+
+    return true;
+}
+
+
+template< int Size, class LockPolicy >
+EventManagerBase::OverflowStats EventManagerBase::EventQueue< Size, LockPolicy >::getOverflowStats()
+{
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    return mOverflowStats;
+}
+
+
+template< int Size, class LockPolicy >
+void EventManagerBase::EventQueue< Size, LockPolicy >::resetOverflowStats()
+{
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    mOverflowStats = OverflowStats();
+}
+
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, LockPolicy >::insertEvent( int eventCode, int eventParam )
+{
+    if ( isFull() )
+    {
+        switch ( mOverflowPolicy )
+        {
+            case kDropOldest:
+                // Make room by discarding the event at the head of the queue
+                mEventQueueHead = ( mEventQueueHead + 1 ) % kEventQueueSize;
+                storeShared( mNumEvents, mNumEvents - 1 );
+                mOverflowStats.droppedOldest++;
+                recordDropped( 1 );
+                break;
+
+            case kOverwriteNewest:
+            {
+                int newest = ( mEventQueueTail ? mEventQueueTail : kEventQueueSize ) - 1;
+                mEventQueue[ newest ].code = eventCode;
+                mEventQueue[ newest ].param = eventParam;
+                stampQueued( &mEventQueue[ newest ] );
+                mOverflowStats.overwritten++;
+                recordDropped( 1 );
+                recordQueued( 1, getNumEvents() );
+                return true;
+            }
+
+            case kSpill:
+                if ( mSpill.push( eventCode, eventParam ) )
+                {
+                    mOverflowStats.spilled++;
+                    recordQueued( 1, getNumEvents() );
+                    return true;
+                }
+                mOverflowStats.droppedNewest++;
+                recordDropped( 1 );
+                return false;
+
+            default:
+                mOverflowStats.droppedNewest++;
+                recordDropped( 1 );
+                return false;
+        }
+    }
+
+    // Store the event at the tail of the queue
+    mEventQueue[ mEventQueueTail ].code = eventCode;
+    mEventQueue[ mEventQueueTail ].param = eventParam;
+    stampQueued( &mEventQueue[ mEventQueueTail ] );
+
+    // Update queue tail value
+    mEventQueueTail = ( mEventQueueTail + 1 ) % kEventQueueSize;
+
+    // Update number of events in queue
+    storeShared( mNumEvents, mNumEvents + 1 );
+
+    recordQueued( 1, mNumEvents );
+
+    return true;
+}
 
-        // Listener structure and corresponding array
-        struct ListenerItem
+
+template< int Size, class LockPolicy >
+inline void EventManagerBase::EventQueue< Size, LockPolicy >::refill()
+{
+    // The queue stays full as long as there are spilled events, so they are always newer
+    // than every event in the queue and order is preserved.  They keep the time they were
+    // first queued.
+    while ( !isFull() && mSpill.pop( &mEventQueue[ mEventQueueTail ] ) )
+    {
+        mEventQueueTail = ( mEventQueueTail + 1 ) % kEventQueueSize;
+        storeShared( mNumEvents, mNumEvents + 1 );
+    }
+}
+
+
+
+//*********  INLINES   EventManagerBase::EventQueue< PowerOfTwoRing >::  ***********
+
+template< int Size, class LockPolicy >
+EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::EventQueue() :
+mEventQueueHead( 0 ),
+mEventQueueTail( 0 ),
+mOverflowPolicy( kDropNewest ),
+mOverflowStats()
+{
+    for ( int i = 0; i < kEventQueueSize; i++ )
+    {
+        mEventQueue[i].code = EventManagerBase::kEventNone;
+        mEventQueue[i].param = 0;
+    }
+}
+
+
+template< int Size, class LockPolicy >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::isEmpty()
+{
+    return ( loadShared( mEventQueueHead ) == loadShared( mEventQueueTail ) );
+}
+
+
+template< int Size, class LockPolicy >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::isFull()
+{
+    return ( static_cast<Counter>( loadShared( mEventQueueTail ) - loadShared( mEventQueueHead ) ) == kEventQueueSize );
+}
+
+
+template< int Size, class LockPolicy >
+inline int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::getNumEvents()
+{
+    // Any spilled events are waiting too
+    return static_cast<Counter>( loadShared( mEventQueueTail ) - loadShared( mEventQueueHead ) ) + mSpill.getNumEvents();
+}
+
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::queueEvent( int eventCode, int eventParam )
+{
+    // The lock MUST be taken BEFORE the full queue check (see the general EventQueue::queueEvent())
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    return insertEvent( eventCode, eventParam );
+}
+
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::queueEvent( int eventCode, int eventParam, CoalesceMode mode )
+{
+    if ( mode == kNoCoalescing )
+    {
+        return queueEvent( eventCode, eventParam );
+    }
+
+    // Search and insert under one lock (see the general EventQueue::queueEvent())
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // Search from the newest event back, starting with any spilled events
+    SpilledEvent* spilled = mSpill.findNewest( eventCode );
+    if ( spilled )
+    {
+        coalesce( &spilled->param, eventParam, mode );
+        return true;
+    }
+
+    for ( Counter c = mEventQueueTail; c != mEventQueueHead; --c )
+    {
+        EventElement& slot = mEventQueue[ static_cast<Counter>( c - 1 ) & kIndexMask ];
+        if ( slot.code == eventCode )
         {
-            EventListener	callback;		// The listener function
-            int				eventCode;		// The event code
-            boolean			enabled;			// Each listener can be enabled or disabled
-        };
-        ListenerItem mListeners[ kMaxListeners ];
+            coalesce( &slot.param, eventParam, mode );
+            return true;
+        }
+    }
 
-        // Callback function to be called for event types which have no listener
-        EventListener mDefaultCallback;
+    return insertEvent( eventCode, eventParam );
+}
 
-        // Once set, the default callback function can be enabled or disabled
-        boolean mDefaultCallbackEnabled;
 
-        // get the current number of entries in the dispatch table
-        int getNumEntries();
+template< int Size, class LockPolicy >
+int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::queueEvents( const Event* events, int numEvents, BatchMode mode )
+{
+    Guard  lock( *this );       // Lock automatically released when exit block
 
-        // returns the array index of the specified listener or -1 if no such event/function couple is found
-        int searchListeners( int eventCode, EventListener listener);
-        int searchListeners( EventListener listener );
-        int searchEventCode( int eventCode );
+    // The overflow policy does not apply to batches:  events that don't fit are rejected
+    int n = batchCount( numEvents, kEventQueueSize - static_cast<Counter>( mEventQueueTail - mEventQueueHead ), mode );
+    for ( int i = 0; i < n; i++ )
+    {
+        EventElement& slot = mEventQueue[ static_cast<Counter>( mEventQueueTail + i ) & kIndexMask ];
+        slot.code = events[i].code;
+        slot.param = events[i].param;
+        stampQueued( &slot );
+    }
+    storeShared<Counter>( mEventQueueTail, mEventQueueTail + n );
 
-    };
+    if ( n )
+    {
+        recordQueued( n, static_cast<Counter>( mEventQueueTail - mEventQueueHead ) );
+    }
+    if ( n < numEvents )
+    {
+        mOverflowStats.droppedNewest += numEvents - n;
+        recordDropped( numEvents - n );
+    }
 
-    EventQueue 	mHighPriorityQueue;
-    EventQueue 	mLowPriorityQueue;
+    return n;
+}
 
-    ListenerList		mListeners;
-};
 
-//*********  INLINES   EventManager::  ***********
+template< int Size, class LockPolicy >
+boolean EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::popEvent( int* eventCode, int* eventParam )
+{
+    // The lock MUST be taken AFTER the empty queue check (see the general EventQueue::popEvent())
+    if ( isEmpty() )
+    {
+        return false;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    // Pop the event from the head of the queue
+    EventElement& slot = mEventQueue[ mEventQueueHead & kIndexMask ];
+    *eventCode  = slot.code;
+    *eventParam = slot.param;
+
+    storeShared<Counter>( mEventQueueHead, mEventQueueHead + 1 );
+
+    refill();
+
+    return true;
+}
+
 
-inline boolean EventManager::addListener( int eventCode, EventListener listener )
+template< int Size, class LockPolicy >
+int EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::popEvents( EventElement* events, int maxEvents )
 {
-    return mListeners.addListener( eventCode, listener );
+    if ( isEmpty() )
+    {
+        return 0;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    int n = static_cast<Counter>( mEventQueueTail - mEventQueueHead );
+    if ( n > maxEvents )
+    {
+        n = maxEvents;
+    }
+    for ( int i = 0; i < n; i++ )
+    {
+        events[i] = mEventQueue[ static_cast<Counter>( mEventQueueHead + i ) & kIndexMask ];
+    }
+    storeShared<Counter>( mEventQueueHead, mEventQueueHead + n );
+
+    refill();
+
+    return n;
 }
 
-inline boolean EventManager::removeListener( int eventCode, EventListener listener )
+
+template< int Size, class LockPolicy >
+boolean EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::setOverflowPolicy( OverflowPolicy policy, SpilledEvent* spillBuffer, int spillSize )
 {
-    return mListeners.removeListener( eventCode, listener );
+    if ( policy == kSpill && ( !spillBuffer || spillSize <= 0 ) )
+    {
+        return false;
+    }
+
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    if ( !mSpill.isEmpty() )
+    {
+        return false;
+    }
+
+    mOverflowPolicy = policy;
+    if ( policy == kSpill )
+    {
+        mSpill.setStorage( spillBuffer, spillSize );
+    }
+    else
+    {
+        mSpill.setStorage( 0, 0 );
+    }
+
+    return true;
 }
 
-inline int EventManager::removeListener( EventListener listener )
+
+template< int Size, class LockPolicy >
+EventManagerBase::OverflowStats EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::getOverflowStats()
 {
-    return mListeners.removeListener( listener );
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    return mOverflowStats;
 }
 
-inline boolean EventManager::enableListener( int eventCode, EventListener listener, boolean enable )
+
+template< int Size, class LockPolicy >
+void EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::resetOverflowStats()
 {
-    return mListeners.enableListener( eventCode, listener, enable );
+    Guard  lock( *this );       // Lock automatically released when exit block
+
+    mOverflowStats = OverflowStats();
 }
 
-inline boolean EventManager::isListenerEnabled( int eventCode, EventListener listener )
+
+template< int Size, class LockPolicy >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::insertEvent( int eventCode, int eventParam )
 {
-    return mListeners.isListenerEnabled( eventCode, listener );
+    if ( isFull() )
+    {
+        switch ( mOverflowPolicy )
+        {
+            case kDropOldest:
+                // Make room by discarding the event at the head of the queue
+                storeShared<Counter>( mEventQueueHead, mEventQueueHead + 1 );
+                mOverflowStats.droppedOldest++;
+                recordDropped( 1 );
+                break;
+
+            case kOverwriteNewest:
+            {
+                EventElement& newest = mEventQueue[ static_cast<Counter>( mEventQueueTail - 1 ) & kIndexMask ];
+                newest.code = eventCode;
+                newest.param = eventParam;
+                stampQueued( &newest );
+                mOverflowStats.overwritten++;
+                recordDropped( 1 );
+                recordQueued( 1, getNumEvents() );
+                return true;
+            }
+
+            case kSpill:
+                if ( mSpill.push( eventCode, eventParam ) )
+                {
+                    mOverflowStats.spilled++;
+                    recordQueued( 1, getNumEvents() );
+                    return true;
+                }
+                mOverflowStats.droppedNewest++;
+                recordDropped( 1 );
+                return false;
+
+            default:
+                mOverflowStats.droppedNewest++;
+                recordDropped( 1 );
+                return false;
+        }
+    }
+
+    // Store the event at the tail of the queue
+    EventElement& slot = mEventQueue[ mEventQueueTail & kIndexMask ];
+    slot.code = eventCode;
+    slot.param = eventParam;
+    stampQueued( &slot );
+
+    storeShared<Counter>( mEventQueueTail, mEventQueueTail + 1 );
+
+    recordQueued( 1, static_cast<Counter>( mEventQueueTail - mEventQueueHead ) );
+
+    return true;
 }
 
-inline boolean EventManager::setDefaultListener( EventListener listener )
+
+template< int Size, class LockPolicy >
+inline void EventManagerBase::EventQueue< Size, EventManagerBase::PowerOfTwoRing< LockPolicy > >::refill()
 {
-    return mListeners.setDefaultListener( listener );
+    // The queue stays full as long as there are spilled events, so they are always newer
+    // than every event in the queue and order is preserved.  They keep the time they were
+    // first queued.
+    while ( !isFull() && mSpill.pop( &mEventQueue[ mEventQueueTail & kIndexMask ] ) )
+    {
+        storeShared<Counter>( mEventQueueTail, mEventQueueTail + 1 );
+    }
 }
 
-inline void EventManager::removeDefaultListener()
+
+
+//*********  INLINES   EventManagerBase::EventQueue< SpscLockFree >::  ***********
+
+template< int Size >
+EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::EventQueue() :
+mEventQueueHead( 0 ),
+mEventQueueTail( 0 ),
+mDroppedNewest( 0 )
 {
-    mListeners.removeDefaultListener();
+    for ( int i = 0; i < kNumSlots; i++ )
+    {
+        mEventQueue[i].code = EventManagerBase::kEventNone;
+        mEventQueue[i].param = 0;
+    }
 }
 
-inline void EventManager::enableDefaultListener( boolean enable )
+
+template< int Size >
+inline typename EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::QueueIndex
+ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::nextIndex( QueueIndex i )
 {
-    mListeners.enableDefaultListener( enable );
+    // Avoids a division (costly on AVR) compared to ( i + 1 ) % kNumSlots
+    return ( i + 1 == kNumSlots ) ? 0 : i + 1;
 }
 
-inline boolean EventManager::isListenerListEmpty()
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::isEmpty()
 {
-    return mListeners.isEmpty();
+    return ( __atomic_load_n( &mEventQueueHead, __ATOMIC_ACQUIRE ) == __atomic_load_n( &mEventQueueTail, __ATOMIC_ACQUIRE ) );
 }
 
-inline boolean EventManager::isListenerListFull()
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::isFull()
 {
-    return mListeners.isFull();
+    return ( nextIndex( __atomic_load_n( &mEventQueueTail, __ATOMIC_ACQUIRE ) ) == __atomic_load_n( &mEventQueueHead, __ATOMIC_ACQUIRE ) );
+}
+
+
+template< int Size >
+inline int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::getNumEvents()
+{
+    int n = __atomic_load_n( &mEventQueueTail, __ATOMIC_ACQUIRE ) - __atomic_load_n( &mEventQueueHead, __ATOMIC_ACQUIRE );
+    return ( n < 0 ) ? n + kNumSlots : n;
+}
+
+
+template< int Size >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::queueEvent( int eventCode, int eventParam )
+{
+    /*
+    * No interrupt suppression here.  Only the (single) producer writes the tail and
+    * only the (single) consumer writes the head.
+    *
+    * The event is stored in the slot BEFORE the new tail is published (release store),
+    * so the consumer can never see the new tail without also seeing the event.  If the
+    * consumer frees a slot after we read the head, we merely report a full queue that
+    * has just gained room, which is harmless.
+    */
+
+    QueueIndex tail = __atomic_load_n( &mEventQueueTail, __ATOMIC_RELAXED );
+    QueueIndex next = nextIndex( tail );
+    QueueIndex head = __atomic_load_n( &mEventQueueHead, __ATOMIC_ACQUIRE );
+
+    if ( next == head )
+    {
+        // Queue is full
+        mDroppedNewest++;
+        recordDropped( 1 );
+        return false;
+    }
+
+    // Store the event at the tail of the queue
+    mEventQueue[ tail ].code = eventCode;
+    mEventQueue[ tail ].param = eventParam;
+    stampQueued( &mEventQueue[ tail ] );
+
+    // Publish the event
+    __atomic_store_n( &mEventQueueTail, next, __ATOMIC_RELEASE );
+
+    recordQueued( 1, ( next >= head ) ? next - head : next - head + kNumSlots );
+
+    return true;
+}
+
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::queueEvent( int eventCode, int eventParam, CoalesceMode )
+{
+    return queueEvent( eventCode, eventParam );
+}
+
+
+template< int Size >
+int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::queueEvents( const Event* events, int numEvents, BatchMode mode )
+{
+    // Fill all the slots first, then publish them with a single store to the tail
+    QueueIndex tail = __atomic_load_n( &mEventQueueTail, __ATOMIC_RELAXED );
+    int room = __atomic_load_n( &mEventQueueHead, __ATOMIC_ACQUIRE ) - tail - 1;
+    if ( room < 0 )
+    {
+        room += kNumSlots;
+    }
+
+    int n = batchCount( numEvents, room, mode );
+    for ( int i = 0; i < n; i++ )
+    {
+        mEventQueue[ tail ].code = events[i].code;
+        mEventQueue[ tail ].param = events[i].param;
+        stampQueued( &mEventQueue[ tail ] );
+        tail = nextIndex( tail );
+    }
+
+    if ( n )
+    {
+        __atomic_store_n( &mEventQueueTail, tail, __ATOMIC_RELEASE );
+        recordQueued( n, kEventQueueSize - room + n );
+    }
+
+    if ( n < numEvents )
+    {
+        mDroppedNewest += numEvents - n;
+        recordDropped( numEvents - n );
+    }
+
+    return n;
+}
+
+
+template< int Size >
+boolean EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::popEvent( int* eventCode, int* eventParam )
+{
+    /*
+    * Mirror image of queueEvent():  the event is read out of the slot BEFORE the new
+    * head is published, so the producer can never reuse the slot while we are still
+    * reading it.
+    */
+
+    QueueIndex head = __atomic_load_n( &mEventQueueHead, __ATOMIC_RELAXED );
+
+    if ( head == __atomic_load_n( &mEventQueueTail, __ATOMIC_ACQUIRE ) )
+    {
+        // Queue is empty
+        return false;
+    }
+
+    // Pop the event from the head of the queue
+    // Store event code and event parameter into the user-supplied variables
+    *eventCode  = mEventQueue[ head ].code;
+    *eventParam = mEventQueue[ head ].param;
+
+    // Release the slot back to the producer
+    __atomic_store_n( &mEventQueueHead, nextIndex( head ), __ATOMIC_RELEASE );
+
+    return true;
+}
+
+
+template< int Size >
+int EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::popEvents( EventElement* events, int maxEvents )
+{
+    // Copy out everything published so far (up to maxEvents), then free all the slots at once
+    QueueIndex head = __atomic_load_n( &mEventQueueHead, __ATOMIC_RELAXED );
+    QueueIndex tail = __atomic_load_n( &mEventQueueTail, __ATOMIC_ACQUIRE );
+
+    int n = 0;
+    while ( n < maxEvents && head != tail )
+    {
+        events[ n++ ] = mEventQueue[ head ];
+        head = nextIndex( head );
+    }
+
+    if ( n )
+    {
+        __atomic_store_n( &mEventQueueHead, head, __ATOMIC_RELEASE );
+    }
+
+    return n;
+}
+
+template< int Size >
+inline boolean EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::setOverflowPolicy( OverflowPolicy policy, SpilledEvent*, int )
+{
+    return ( policy == kDropNewest );
+}
+
+
+template< int Size >
+inline EventManagerBase::OverflowStats EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::getOverflowStats()
+{
+    OverflowStats stats = OverflowStats();
+    stats.droppedNewest = mDroppedNewest;
+    return stats;
+}
+
+
+template< int Size >
+inline void EventManagerBase::EventQueue< Size, EventManagerBase::SpscLockFree >::resetOverflowStats()
+{
+    mDroppedNewest = 0;
+}
+
+
+
+
+#if EVENTMANAGER_HAS_CAS
+
+//*********  INLINES   EventManagerBase::EventQueue< MpscLockFree >::  ***********
+
+template< int Size >
+EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::EventQueue() :
+mEnqueuePos( 0 ),
+mDequeuePos( 0 ),
+mDroppedNewest( 0 )
+{
+    for ( int i = 0; i < kEventQueueSize; i++ )
+    {
+        mEventQueue[i].sequence = i;
+        mEventQueue[i].event.code = EventManagerBase::kEventNone;
+        mEventQueue[i].event.param = 0;
+    }
+}
+
+
+template< int Size >
+inline int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::getNumEvents()
+{
+    // Read the dequeue position first so the result can never be negative
+    unsigned int head = __atomic_load_n( &mDequeuePos, __ATOMIC_ACQUIRE );
+    unsigned int tail = __atomic_load_n( &mEnqueuePos, __ATOMIC_ACQUIRE );
+    return static_cast<int>( tail - head );
+}
+
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::isEmpty()
+{
+    return ( getNumEvents() == 0 );
+}
+
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::isFull()
+{
+    return ( getNumEvents() >= kEventQueueSize );
+}
+
+
+template< int Size >
+boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::queueEvent( int eventCode, int eventParam )
+{
+    /*
+    * Reserve a slot by advancing mEnqueuePos with a compare-and-swap.  The slot for
+    * position pos is free when its sequence equals pos; if the sequence lags behind,
+    * the consumer has not released the slot yet and the queue is full.  If it is
+    * ahead, another producer beat us to this position, so reload and try again.
+    *
+    * Once the slot is ours nobody else can touch it until we publish it by storing
+    * pos + 1 into its sequence (release), which makes the event visible to popEvent().
+    */
+
+    unsigned int pos = __atomic_load_n( &mEnqueuePos, __ATOMIC_RELAXED );
+    Slot* slot;
+
+    for ( ;; )
+    {
+        slot = &mEventQueue[ pos & kIndexMask ];
+        unsigned int seq = __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE );
+        int diff = static_cast<int>( seq - pos );
+
+        if ( diff == 0 )
+        {
+            // On failure pos is reloaded with the current value of mEnqueuePos
+            if ( __atomic_compare_exchange_n( &mEnqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+            {
+                break;
+            }
+        }
+        else if ( diff < 0 )
+        {
+            // Queue is full
+            __atomic_fetch_add( &mDroppedNewest, 1, __ATOMIC_RELAXED );
+            recordDropped( 1 );
+            return false;
+        }
+        else
+        {
+            pos = __atomic_load_n( &mEnqueuePos, __ATOMIC_RELAXED );
+        }
+    }
+
+    // Store the event in the reserved slot
+    slot->event.code = eventCode;
+    slot->event.param = eventParam;
+    stampQueued( &slot->event );
+
+    // Publish the event
+    __atomic_store_n( &slot->sequence, pos + 1, __ATOMIC_RELEASE );
+
+    recordQueued( 1, static_cast<int>( pos + 1 - __atomic_load_n( &mDequeuePos, __ATOMIC_RELAXED ) ) );
+
+    return true;
 }
 
-inline boolean EventManager::isEventQueueEmpty( EventPriority pri )
+
+template< int Size >
+inline boolean ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::queueEvent( int eventCode, int eventParam, CoalesceMode )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.isEmpty() : mLowPriorityQueue.isEmpty();
+    return queueEvent( eventCode, eventParam );
 }
 
-inline boolean EventManager::isEventQueueFull( EventPriority pri )
+
+template< int Size >
+int ISR_ATTR EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::queueEvents( const Event* events, int numEvents, BatchMode mode )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.isFull() : mLowPriorityQueue.isFull();
+    /*
+    * Reserve n consecutive positions with one compare-and-swap.  The consumer releases slots
+    * in order, setting each slot's sequence before advancing mDequeuePos, so every position
+    * below mDequeuePos + kEventQueueSize is free for its lap once it has been read (acquire).
+    * A stale mDequeuePos only underestimates the room, which is harmless.
+    */
+
+    unsigned int pos = __atomic_load_n( &mEnqueuePos, __ATOMIC_RELAXED );
+    unsigned int head;
+    int n;
+
+    for ( ;; )
+    {
+        head = __atomic_load_n( &mDequeuePos, __ATOMIC_ACQUIRE );
+        int room = kEventQueueSize - static_cast<int>( pos - head );
+
+        n = batchCount( numEvents, ( room > 0 ) ? room : 0, mode );
+        if ( !n )
+        {
+            if ( numEvents > 0 )
+            {
+                __atomic_fetch_add( &mDroppedNewest, numEvents, __ATOMIC_RELAXED );
+                recordDropped( numEvents );
+            }
+            return 0;
+        }
+
+        // On failure pos is reloaded with the current value of mEnqueuePos
+        if ( __atomic_compare_exchange_n( &mEnqueuePos, &pos, pos + n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+        {
+            break;
+        }
+    }
+
+    for ( int i = 0; i < n; i++ )
+    {
+        Slot& slot = mEventQueue[ ( pos + i ) & kIndexMask ];
+        slot.event.code = events[i].code;
+        slot.event.param = events[i].param;
+        stampQueued( &slot.event );
+    }
+
+    // Publish the events last to first:  the consumer stops at the first slot, so it cannot
+    // see any event of the batch until all of them are visible
+    for ( int i = n - 1; i >= 0; i-- )
+    {
+        __atomic_store_n( &mEventQueue[ ( pos + i ) & kIndexMask ].sequence, pos + i + 1, __ATOMIC_RELEASE );
+    }
+
+    recordQueued( n, static_cast<int>( pos + n - head ) );
+
+    if ( n < numEvents )
+    {
+        __atomic_fetch_add( &mDroppedNewest, numEvents - n, __ATOMIC_RELAXED );
+        recordDropped( numEvents - n );
+    }
+
+    return n;
 }
 
-inline int EventManager::getNumEventsInQueue( EventPriority pri )
+
+template< int Size >
+inline boolean EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::popEvent( int* eventCode, int* eventParam )
 {
-    return ( pri == kHighPriority ) ? mHighPriorityQueue.getNumEvents() : mLowPriorityQueue.getNumEvents();
+    EventElement event;
+    if ( !popElement( &event ) )
+    {
+        return false;
+    }
+
+    // Store event code and event parameter into the user-supplied variables
+    *eventCode  = event.code;
+    *eventParam = event.param;
+
+    return true;
 }
 
-inline boolean EventManager::queueEvent( int eventCode, int eventParam, EventPriority pri )
+
+template< int Size >
+boolean EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::popElement( EventElement* event )
 {
-    return ( pri == kHighPriority ) ?
-        mHighPriorityQueue.queueEvent( eventCode, eventParam ) : mLowPriorityQueue.queueEvent( eventCode, eventParam );
+    unsigned int pos = __atomic_load_n( &mDequeuePos, __ATOMIC_RELAXED );
+    Slot* slot = &mEventQueue[ pos & kIndexMask ];
+
+    if ( __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE ) != pos + 1 )
+    {
+        // Queue is empty, or the producer of the head event has not published it yet
+        return false;
+    }
+
+    // Pop the event from the head of the queue
+    *event = slot->event;
+
+    // Hand the slot back to producers for use one lap later
+    __atomic_store_n( &slot->sequence, pos + kEventQueueSize, __ATOMIC_RELEASE );
+    __atomic_store_n( &mDequeuePos, pos + 1, __ATOMIC_RELEASE );
+
+    return true;
 }
 
 
+template< int Size >
+int EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::popEvents( EventElement* events, int maxEvents )
+{
+    // There is no lock to amortize; each slot is handed back as soon as it is read
+    int n = 0;
+    while ( n < maxEvents && popElement( &events[n] ) )
+    {
+        ++n;
+    }
+
+    return n;
+}
 
+template< int Size >
+inline boolean EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::setOverflowPolicy( OverflowPolicy policy, SpilledEvent*, int )
+{
+    return ( policy == kDropNewest );
+}
 
-//*********  INLINES   EventManager::EventQueue::  ***********
 
-inline boolean EventManager::EventQueue::isEmpty()
+template< int Size >
+inline EventManagerBase::OverflowStats EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::getOverflowStats()
 {
-    return ( mNumEvents == 0 );
+    OverflowStats stats = OverflowStats();
+    stats.droppedNewest = __atomic_load_n( &mDroppedNewest, __ATOMIC_RELAXED );
+    return stats;
 }
 
 
-inline boolean EventManager::EventQueue::isFull()
+template< int Size >
+inline void EventManagerBase::EventQueue< Size, EventManagerBase::MpscLockFree >::resetOverflowStats()
 {
-    return ( mNumEvents == kEventQueueSize );
+    __atomic_store_n( &mDroppedNewest, 0, __ATOMIC_RELAXED );
 }
 
 
-inline int EventManager::EventQueue::getNumEvents()
+#endif
+
+
+
+//*********  INLINES   EventManagerBase::ListenerList::  ***********
+
+inline boolean EventManagerBase::ListenerList::isEmpty()
 {
-    return mNumEvents;
+    return (mNumListeners + mNumPending - mNumRemoved == 0);
 }
 
+inline boolean EventManagerBase::ListenerList::isFull()
+{
+    return (mNumListeners + mNumPending - mNumRemoved == mMaxListeners);
+}
 
+inline boolean EventManagerBase::ListenerList::matches( int pos, int eventCode )
+{
+    const ListenerInfo& info = mInfo[ mOrder[ pos ] ];
+    switch ( info.match )
+    {
+        case kMatchRange:   return ( eventCode >= mCodes[ pos ] ) && ( eventCode <= info.matchData );
+        case kMatchMask:    return ( eventCode & info.matchData ) == mCodes[ pos ];
+        default:            return eventCode == mCodes[ pos ];
+    }
+}
 
-//*********  INLINES   EventManager::ListenerList::  ***********
+inline EventManagerBase::ListenerHandle EventManagerBase::ListenerList::handleOf( int k )
+{
+    return ( static_cast<ListenerHandle>( mInfo[ k ].generation ) << 8 ) | ( k + 1 );
+}
 
-inline boolean EventManager::ListenerList::isEmpty()
+inline boolean EventManagerBase::ListenerList::isSlotEnabled( int slot )
 {
-    return (mNumListeners == 0);
+    return ( mEnabled[ slot >> 3 ] >> ( slot & 7 ) ) & 1;
 }
 
-inline boolean EventManager::ListenerList::isFull()
+inline void EventManagerBase::ListenerList::enableSlot( int slot, boolean enable )
 {
-    return (mNumListeners == kMaxListeners);
+    if ( enable )
+    {
+        mEnabled[ slot >> 3 ] |= ( 1 << ( slot & 7 ) );
+    }
+    else
+    {
+        mEnabled[ slot >> 3 ] &= ~( 1 << ( slot & 7 ) );
+    }
 }
 
-inline int EventManager::ListenerList::getNumEntries()
+inline int EventManagerBase::ListenerList::getNumEntries()
 {
     return mNumListeners;
 }
@@ -0,0 +1,26 @@
+/*
+ * TestCheck.h
+ *
+ * CHECK() for the host tests:  unlike assert() it is never compiled out, and it
+ * reports the failing condition and exits with a failure status.
+ *
+ */
+
+
+#ifndef TestCheck_h
+#define TestCheck_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK( condition )                                                                  \
+    do                                                                                      \
+    {                                                                                       \
+        if ( !( condition ) )                                                               \
+        {                                                                                   \
+            fprintf( stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition ); \
+            exit( 1 );                                                                      \
+        }                                                                                   \
+    } while ( 0 )
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * Arduino.h
+ *
+ * Stand-in for the Arduino core, so that EventManager can be built and tested on
+ * a host computer.  Provides only what the library uses:  boolean, micros(),
+ * millis(), and a Print/Serial that writes to stdout.
+ *
+ * Signals play the role of interrupts on the host.
+ *
+ */
+
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <chrono>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define DEC     10
+#define HEX     16
+
+
+inline unsigned long micros()
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return static_cast<unsigned long>(
+        std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count() );
+}
+
+inline unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+
+class Print
+{
+public:
+
+    virtual ~Print() {}
+
+    virtual size_t write( uint8_t c )
+    {
+        return fputc( c, stdout ) != EOF;
+    }
+
+    size_t print( const char* s )
+    {
+        size_t n = 0;
+        while ( *s )
+        {
+            n += write( *s++ );
+        }
+        return n;
+    }
+
+    size_t print( long value, int base = DEC )
+    {
+        char buffer[ 24 ];
+        snprintf( buffer, sizeof buffer, ( base == HEX ) ? "%lx" : "%ld", value );
+        return print( buffer );
+    }
+
+    size_t print( unsigned long value, int base = DEC )
+    {
+        char buffer[ 24 ];
+        snprintf( buffer, sizeof buffer, ( base == HEX ) ? "%lx" : "%lu", value );
+        return print( buffer );
+    }
+
+    size_t print( int value, int base = DEC )                   { return print( static_cast<long>( value ), base ); }
+    size_t print( unsigned int value, int base = DEC )          { return print( static_cast<unsigned long>( value ), base ); }
+
+    size_t println()                                            { return print( "\n" ); }
+
+    template< class T > size_t println( T value )               { size_t n = print( value ); return n + println(); }
+    template< class T > size_t println( T value, int base )     { size_t n = print( value, base ); return n + println(); }
+};
+
+
+class HardwareSerial : public Print
+{
+};
+
+static HardwareSerial Serial;
+
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * bench_lock_contention.cpp
+ *
+ * Measures how each lock policy copes with contention:  producer threads queue
+ * events while the main thread processes them, first all into the same queue and
+ * then split between the high and low priority queues, which have independent
+ * locks.  Prints the throughput of each case, and checks that nothing was lost.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+static const int kEventsPerProducer = 50000;
+
+static long gHandled;
+
+
+static void listener( int, int )
+{
+    gHandled++;
+}
+
+
+template< class Manager >
+static void run( const char* name, int numProducers, boolean splitQueues )
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    gHandled = 0;
+
+    std::atomic<bool> go( false );
+    std::vector<std::thread> producers;
+    for ( int p = 0; p < numProducers; p++ )
+    {
+        // With split queues, half the producers use each queue
+        EventManager::EventPriority pri = ( splitQueues && ( p & 1 ) ) ? EventManager::kHighPriority : EventManager::kLowPriority;
+        producers.push_back( std::thread( [ eventManager, &go, pri ]
+        {
+            while ( !go )
+            {
+                std::this_thread::yield();
+            }
+            for ( int i = 0; i < kEventsPerProducer; i++ )
+            {
+                while ( !eventManager->queueEvent( EventManager::kEventUser0, i, pri ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    go = true;
+
+    long expected = static_cast<long>( numProducers ) * kEventsPerProducer;
+    while ( gHandled < expected )
+    {
+        if ( !eventManager->processAllEvents() )
+        {
+            std::this_thread::yield();
+        }
+    }
+    for ( size_t i = 0; i < producers.size(); i++ )
+    {
+        producers[i].join();
+    }
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    printf( "%-26s %d producers, %s:  %6.2f million events/s\n", name, numProducers,
+            splitQueues ? "two queues" : "one queue ", gHandled / seconds / 1e6 );
+
+    CHECK( gHandled == expected );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kHighPriority ) );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kLowPriority ) );
+
+    delete eventManager;
+}
+
+
+template< class LockPolicy >
+static void runAll( const char* name )
+{
+    typedef SizedEventManager< 64, 64, 1, LockPolicy > Manager;
+    for ( int numProducers = 1; numProducers <= 4; numProducers *= 2 )
+    {
+        run< Manager >( name, numProducers, false );
+        if ( numProducers > 1 )
+        {
+            run< Manager >( name, numProducers, true );
+        }
+    }
+}
+
+
+int main()
+{
+    printf( "%u hardware threads\n", std::thread::hardware_concurrency() );
+
+    runAll< EventManager::MutexLock >( "MutexLock" );
+    runAll< EventManager::SpinLock >( "SpinLock" );
+    runAll< EventManager::InterruptMask >( "InterruptMask" );
+    runAll< EventManager::PowerOfTwoRing< EventManager::SpinLock > >( "PowerOfTwoRing<SpinLock>" );
+#if EVENTMANAGER_HAS_CAS
+    runAll< EventManager::MpscLockFree >( "MpscLockFree" );
+#endif
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * bench_pow2_ring.cpp
+ *
+ * Checks that a PowerOfTwoRing queue behaves exactly like the default queue (order,
+ * capacity, wrap-around at the end of the ring), then compares the cost of
+ * queueing and processing an event with each.  On x86 the cost is measured in TSC
+ * cycles, elsewhere in nanoseconds.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <chrono>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#define TIMESTAMP()     __rdtsc()
+#define TIMESTAMP_UNIT  "cycles"
+#else
+#define TIMESTAMP()     static_cast<unsigned long long>( std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count() )
+#define TIMESTAMP_UNIT  "ns"
+#endif
+
+
+static const int kQueueSize = 16;
+
+static int gLast;
+static long gHandled;
+
+
+static void listener( int, int param )
+{
+    gLast = param;
+    gHandled++;
+}
+
+
+// Fill the queue with every count from empty to one past full, many times over, so the
+// head and tail start from every slot of the ring
+template< class Manager >
+static void check( const char* name )
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+
+    for ( int round = 0; round < 5000; round++ )
+    {
+        int count = round % ( kQueueSize + 2 );
+        for ( int i = 0; i < count; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) == ( i < kQueueSize ) );
+        }
+        int queued = ( count < kQueueSize ) ? count : kQueueSize;
+        CHECK( eventManager->getNumEventsInQueue() == queued );
+        CHECK( eventManager->isEventQueueFull() == ( queued == kQueueSize ) );
+
+        for ( int i = 0; i < queued; i++ )
+        {
+            CHECK( eventManager->processEvent() == 1 );
+            CHECK( gLast == i );
+        }
+        CHECK( eventManager->isEventQueueEmpty() );
+        CHECK( eventManager->processEvent() == 0 );
+    }
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+// Best of many runs of queueing two events and processing them
+template< class Manager >
+static double bench()
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+
+    const int kIterations = 10000;
+    unsigned long long best = ~0ULL;
+    for ( int rep = 0; rep < 50; rep++ )
+    {
+        unsigned long long start = TIMESTAMP();
+        for ( int i = 0; i < kIterations; i++ )
+        {
+            eventManager->queueEvent( EventManager::kEventUser0, i );
+            eventManager->queueEvent( EventManager::kEventUser0, i );
+            eventManager->processEvent();
+            eventManager->processEvent();
+        }
+        unsigned long long elapsed = TIMESTAMP() - start;
+        if ( elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    delete eventManager;
+    return best / ( 2.0 * kIterations );
+}
+
+
+int main()
+{
+    typedef SizedEventManager< kQueueSize, kQueueSize, 1, EventManager::NoLock > ModuloManager;
+    typedef SizedEventManager< kQueueSize, kQueueSize, 1, EventManager::PowerOfTwoRing< EventManager::NoLock > > RingManager;
+    typedef SizedEventManager< kQueueSize, kQueueSize, 1, EventManager::PowerOfTwoRing< EventManager::InterruptMask > > MaskedRingManager;
+
+    check< ModuloManager >( "modulo" );
+    check< RingManager >( "PowerOfTwoRing" );
+    check< MaskedRingManager >( "PowerOfTwoRing<InterruptMask>" );
+
+    double modulo = bench< ModuloManager >();
+    double ring = bench< RingManager >();
+    printf( "modulo queue:    %6.1f %s per event queued and processed\n", modulo, TIMESTAMP_UNIT );
+    printf( "PowerOfTwoRing:  %6.1f %s per event queued and processed\n", ring, TIMESTAMP_UNIT );
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * test_batched_draining.cpp
+ *
+ * processAllEvents() takes events out of the queues EVENTMANAGER_BATCH_SIZE at a time and
+ * dispatches the whole batch before it looks at the queues again.  A high priority event
+ * queued by a listener part way through a batch of low priority events is handled as soon
+ * as that batch is finished, before the next batch, and a low priority event queued the
+ * same way waits behind every event already queued.  Checked for every position of the
+ * queueing listener in queues of sizes around the batch boundaries.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <vector>
+
+
+static const int kBatch = EVENTMANAGER_BATCH_SIZE;
+
+static int gTrigger;
+
+// The events handled:  low priority ones as their param, high priority ones as 1000 + param
+static std::vector<int> gHandled;
+
+// The manager under test, one per manager type
+template< class M >
+static M*& manager()
+{
+    static M* eventManager;
+    return eventManager;
+}
+
+template< class M >
+static void onLow( int, int param )
+{
+    gHandled.push_back( param );
+    if ( param == gTrigger )
+    {
+        CHECK( manager< M >()->queueEvent( EventManager::kEventUser1, param, EventManager::kHighPriority ) );
+        CHECK( manager< M >()->queueEvent( EventManager::kEventUser0, 500 ) );
+    }
+}
+
+static void onHigh( int, int param )
+{
+    gHandled.push_back( 1000 + param );
+}
+
+
+template< class M >
+static void run( const char* name )
+{
+    const int sizes[] = { 1, kBatch - 1, kBatch, kBatch + 1, 2 * kBatch, 2 * kBatch + 3 };
+
+    for ( unsigned s = 0; s < sizeof( sizes ) / sizeof( sizes[0] ); s++ )
+    {
+        int numEvents = sizes[s];
+        if ( numEvents < 1 )
+        {
+            continue;
+        }
+
+        // Without a trigger, every event in order, however the batches fall
+        M* eventManager = new M;
+        manager< M >() = eventManager;
+        eventManager->addListener( EventManager::kEventUser0, onLow< M > );
+        eventManager->addListener( EventManager::kEventUser1, onHigh );
+        gTrigger = -1;
+        gHandled.clear();
+        for ( int i = 0; i < numEvents; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+        }
+        CHECK( eventManager->processAllEvents() == numEvents );
+        CHECK( static_cast<int>( gHandled.size() ) == numEvents );
+        for ( int i = 0; i < numEvents; i++ )
+        {
+            CHECK( gHandled[i] == i );
+        }
+        CHECK( eventManager->isEventQueueEmpty() );
+
+        // The listener for event trigger queues a high and a low priority event
+        for ( int trigger = 0; trigger < numEvents; trigger++ )
+        {
+            gTrigger = trigger;
+            gHandled.clear();
+            for ( int i = 0; i < numEvents; i++ )
+            {
+                CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+            }
+            CHECK( eventManager->processAllEvents() == numEvents + 2 );
+
+            // The rest of the trigger's batch, then the high priority event, then the
+            // remaining batches, then the low priority event queued last
+            int batchEnd = ( trigger / kBatch + 1 ) * kBatch;
+            if ( batchEnd > numEvents )
+            {
+                batchEnd = numEvents;
+            }
+            std::vector<int> expected;
+            for ( int i = 0; i < batchEnd; i++ )
+            {
+                expected.push_back( i );
+            }
+            expected.push_back( 1000 + trigger );
+            for ( int i = batchEnd; i < numEvents; i++ )
+            {
+                expected.push_back( i );
+            }
+            expected.push_back( 500 );
+            CHECK( gHandled == expected );
+            CHECK( eventManager->isEventQueueEmpty() );
+        }
+
+        delete eventManager;
+    }
+
+    printf( "%-30s batch of %d:  ok\n", name, kBatch );
+}
+
+
+int main()
+{
+    run< SizedEventManager< 4, 32, 2 > >( "InterruptMask" );
+    run< SizedEventManager< 4, 32, 2, EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+    run< SizedEventManager< 4, 32, 2, EventManager::SpscLockFree > >( "SpscLockFree" );
+#if EVENTMANAGER_HAS_CAS
+    run< SizedEventManager< 4, 32, 2, EventManager::MpscLockFree > >( "MpscLockFree" );
+#endif
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * test_coalescing.cpp
+ *
+ * Checks each coalescing mode on the queues that support it:  events with a coalesced
+ * code merge into the one already waiting instead of taking a slot, even when the
+ * queue is full, while other codes and lock-free queues queue every event.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+
+static const int kReplaced = EventManager::kEventUser0;
+static const int kSummed = EventManager::kEventUser1;
+static const int kOred = EventManager::kEventUser2;
+static const int kPlain = EventManager::kEventUser3;
+
+static int gCalls;
+static int gLastCode;
+static int gLastParam;
+
+
+static void listener( int eventCode, int param )
+{
+    gCalls++;
+    gLastCode = eventCode;
+    gLastParam = param;
+}
+
+
+template< class Manager >
+static void run( const char* name )
+{
+    Manager* eventManager = new Manager;
+    eventManager->setDefaultListener( listener );
+
+    CHECK( eventManager->setCoalescing( kReplaced, EventManager::kCoalesceReplace ) );
+    CHECK( eventManager->setCoalescing( kSummed, EventManager::kCoalesceSum ) );
+    CHECK( eventManager->setCoalescing( kOred, EventManager::kCoalesceOr ) );
+
+    for ( int i = 1; i <= 5; i++ )
+    {
+        CHECK( eventManager->queueEvent( kReplaced, i ) );
+        CHECK( eventManager->queueEvent( kSummed, i ) );
+        CHECK( eventManager->queueEvent( kOred, 1 << i ) );
+    }
+    CHECK( eventManager->getNumEventsInQueue() == 3 );
+
+    // One dispatch each, in the order the codes were first queued
+    gCalls = 0;
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( gLastCode == kReplaced && gLastParam == 5 );
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( gLastCode == kSummed && gLastParam == 1 + 2 + 3 + 4 + 5 );
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( gLastCode == kOred && gLastParam == 0x3e );
+    CHECK( gCalls == 3 );
+
+    // Once handled, the next event with the code is queued afresh
+    CHECK( eventManager->queueEvent( kSummed, 10 ) );
+    CHECK( eventManager->processAllEvents() == 1 );
+    CHECK( gLastParam == 10 );
+
+    // Other codes are never merged
+    CHECK( eventManager->queueEvent( kPlain, 1 ) );
+    CHECK( eventManager->queueEvent( kPlain, 2 ) );
+    CHECK( eventManager->getNumEventsInQueue() == 2 );
+    eventManager->processAllEvents();
+
+    // Nor are events of a code whose coalescing is turned off again
+    CHECK( eventManager->setCoalescing( kReplaced, EventManager::kNoCoalescing ) );
+    CHECK( eventManager->queueEvent( kReplaced, 1 ) );
+    CHECK( eventManager->queueEvent( kReplaced, 2 ) );
+    CHECK( eventManager->getNumEventsInQueue() == 2 );
+    eventManager->processAllEvents();
+
+    // A full queue still accepts an event that merges into a waiting one
+    CHECK( eventManager->queueEvent( kSummed, 1 ) );
+    while ( !eventManager->isEventQueueFull() )
+    {
+        CHECK( eventManager->queueEvent( kPlain, 0 ) );
+    }
+    CHECK( !eventManager->queueEvent( kPlain, 0 ) );
+    CHECK( !eventManager->queueEvent( kOred, 1 ) );
+    CHECK( eventManager->queueEvent( kSummed, 2 ) );
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( gLastCode == kSummed && gLastParam == 3 );
+    eventManager->processAllEvents();
+
+    // The table holds EVENTMANAGER_COALESCE_LIST_SIZE codes, and a code that is turned off
+    // frees its entry
+    CHECK( eventManager->setCoalescing( kPlain, EventManager::kCoalesceSum ) );
+    CHECK( eventManager->setCoalescing( kPlain + 1, EventManager::kCoalesceSum ) );
+    CHECK( !eventManager->setCoalescing( kPlain + 2, EventManager::kCoalesceSum ) );
+    CHECK( eventManager->setCoalescing( kPlain + 1, EventManager::kNoCoalescing ) );
+    CHECK( eventManager->setCoalescing( kPlain + 2, EventManager::kCoalesceSum ) );
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+int main()
+{
+    run< EventManager >( "InterruptMask" );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+
+    // The lock-free queues never coalesce:  every event takes a slot
+    EventManagerT< EventManager::SpscLockFree > lockFree;
+    lockFree.setDefaultListener( listener );
+    CHECK( lockFree.setCoalescing( kSummed, EventManager::kCoalesceSum ) );
+    CHECK( lockFree.queueEvent( kSummed, 1 ) );
+    CHECK( lockFree.queueEvent( kSummed, 2 ) );
+    CHECK( lockFree.getNumEventsInQueue() == 2 );
+    gCalls = 0;
+    CHECK( lockFree.processAllEvents() == 2 );
+    CHECK( gCalls == 2 && gLastParam == 2 );
+    printf( "%-30s ok\n", "SpscLockFree" );
+
+    return 0;
+}
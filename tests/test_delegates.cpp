@@ -0,0 +1,86 @@
+/*
+ * test_delegates.cpp
+ *
+ * Listeners with a context pointer and bound member functions:  each delegate calls its
+ * own object, delegates compare equal only with the same function and context, and
+ * remove and enable pick out exactly the delegate they are given.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+
+static int gPlainCalls;
+
+static void onPlain( int, int )
+{
+    gPlainCalls++;
+}
+
+static void onContext( void* context, int, int param )
+{
+    *static_cast<int*>( context ) += param;
+}
+
+struct Motor
+{
+    int ticks;
+
+    Motor() : ticks( 0 ) {}
+
+    void onTick( int, int param )
+    {
+        ticks += param;
+    }
+};
+
+
+int main()
+{
+    typedef EventManager::Delegate Delegate;
+
+    EventManager eventManager;
+    int first = 0;
+    int second = 0;
+    Motor left;
+    Motor right;
+
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onPlain ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onContext, &first ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onContext, &second ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser1, Delegate::bind< Motor, &Motor::onTick >( &left ) ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser1, Delegate::bind< Motor, &Motor::onTick >( &right ) ) );
+
+    // An empty delegate is refused
+    CHECK( !Delegate().isValid() );
+    CHECK( !eventManager.addListener( EventManager::kEventUser2, Delegate() ) );
+
+    // The same function with another context is another delegate
+    CHECK( Delegate( onContext, &first ) == Delegate( onContext, &first ) );
+    CHECK( !( Delegate( onContext, &first ) == Delegate( onContext, &second ) ) );
+    CHECK( !( Delegate::bind< Motor, &Motor::onTick >( &left ) == Delegate::bind< Motor, &Motor::onTick >( &right ) ) );
+
+    // Each delegate reaches its own object
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 3 ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventUser1, 4 ) );
+    CHECK( eventManager.processAllEvents() == 5 );
+    CHECK( gPlainCalls == 1 && first == 3 && second == 3 );
+    CHECK( left.ticks == 4 && right.ticks == 4 );
+
+    // Removing or disabling one delegate leaves the others with the same function alone
+    CHECK( eventManager.removeListener( EventManager::kEventUser0, Delegate( onContext, &first ) ) );
+    CHECK( !eventManager.removeListener( EventManager::kEventUser0, Delegate( onContext, &first ) ) );
+    CHECK( eventManager.enableListener( EventManager::kEventUser1, Delegate::bind< Motor, &Motor::onTick >( &right ), false ) );
+    CHECK( eventManager.removeListener( onPlain ) == 1 );
+
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 1 ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventUser1, 1 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( gPlainCalls == 1 && first == 3 && second == 4 );
+    CHECK( left.ticks == 5 && right.ticks == 4 );
+
+    printf( "delegates ok:  %d bytes each\n", static_cast<int>( sizeof( Delegate ) ) );
+    return 0;
+}
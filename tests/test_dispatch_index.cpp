@@ -0,0 +1,145 @@
+/*
+ * test_dispatch_index.cpp
+ *
+ * Adds, removes, disables and enables listeners at random and sends an event after
+ * each change, checking against a plain list of the listeners that exactly the right
+ * ones are called, in the order they were added.  The event codes straddle the start
+ * of the predefined codes, so with EVENTMANAGER_DIRECT_DISPATCH both the direct table
+ * and the binary search are exercised.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <stdlib.h>
+
+#include <utility>
+#include <vector>
+
+
+static const int kMaxListeners = 64;
+static const int kNumFunctions = 5;
+
+// The listener functions, each of which records ( event code, its number )
+static std::vector< std::pair< int, int > > gCalls;
+static int gDefaultCalls;
+
+template< int N >
+static void listener( int eventCode, int )
+{
+    gCalls.push_back( std::make_pair( eventCode, N ) );
+}
+
+static void defaultListener( int, int )
+{
+    gDefaultCalls++;
+}
+
+static const EventManager::EventListener kFunctions[ kNumFunctions ] =
+{
+    listener<0>, listener<1>, listener<2>, listener<3>, listener<4>
+};
+
+
+// The model:  the listeners in the order they were added
+struct ModelListener
+{
+    int                             code;
+    int                             function;
+    boolean                         enabled;
+    EventManager::ListenerHandle    handle;
+};
+
+
+int main()
+{
+    typedef SizedEventManager< 8, 8, kMaxListeners > Manager;
+    Manager* eventManager = new Manager;
+    eventManager->setDefaultListener( defaultListener );
+
+    std::vector< ModelListener > model;
+    srand( 1 );
+
+    for ( int step = 0; step < 50000; step++ )
+    {
+        int code = EventManager::kEventNone - 10 + rand() % 70;
+        int function = rand() % kNumFunctions;
+
+        int op = rand() % 16;
+        if ( op < 7 )
+        {
+            EventManager::ListenerHandle handle = eventManager->addListener( code, kFunctions[ function ] );
+            CHECK( ( handle != 0 ) == ( model.size() < static_cast<size_t>( kMaxListeners ) ) );
+            if ( handle )
+            {
+                ModelListener added = { code, function, true, handle };
+                model.push_back( added );
+            }
+        }
+        else if ( op < 13 )
+        {
+            // Removes the first listener added with this code and function
+            boolean found = false;
+            for ( size_t i = 0; i < model.size(); i++ )
+            {
+                if ( model[i].code == code && model[i].function == function )
+                {
+                    model.erase( model.begin() + i );
+                    found = true;
+                    break;
+                }
+            }
+            CHECK( eventManager->removeListener( code, kFunctions[ function ] ) == found );
+        }
+        else if ( op < 15 && !model.empty() )
+        {
+            ModelListener& toggled = model[ rand() % model.size() ];
+            toggled.enabled = !toggled.enabled;
+            CHECK( eventManager->enableListener( toggled.handle, toggled.enabled ) );
+            CHECK( eventManager->isListenerEnabled( toggled.handle ) == toggled.enabled );
+            code = toggled.code;
+        }
+        else if ( rand() % 4 == 0 )
+        {
+            // Removes every listener with this function
+            int removed = 0;
+            for ( size_t i = 0; i < model.size(); )
+            {
+                if ( model[i].function == function )
+                {
+                    model.erase( model.begin() + i );
+                    removed++;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            CHECK( eventManager->removeListener( kFunctions[ function ] ) == removed );
+        }
+
+        gCalls.clear();
+        gDefaultCalls = 0;
+        CHECK( eventManager->queueEvent( code, 0 ) );
+        eventManager->processEvent();
+
+        // The default listener handles the events no enabled listener handles
+        std::vector< std::pair< int, int > > expected;
+        for ( size_t i = 0; i < model.size(); i++ )
+        {
+            if ( model[i].code == code && model[i].enabled )
+            {
+                expected.push_back( std::make_pair( code, model[i].function ) );
+            }
+        }
+        CHECK( gCalls == expected );
+        CHECK( gDefaultCalls == ( expected.empty() ? 1 : 0 ) );
+        CHECK( eventManager->numListeners() == static_cast<int>( model.size() ) );
+    }
+
+    printf( "dispatch index ok\n" );
+    delete eventManager;
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * test_event_latency.cpp
+ *
+ * Queue residence times (EVENTMANAGER_EVENT_LATENCY), on a clock the test controls:
+ * each event's wait from being queued until it is dispatched goes into the statistics
+ * of its own priority level, for every kind of queue, for events queued one at a time
+ * or in batches, and for coalesced and spilled events from when they were first queued.
+ * Also checks the histogram and the percentiles estimated from it.
+ *
+ */
+
+
+static unsigned long gClock;
+#define EVENTMANAGER_LATENCY_CLOCK()    gClock
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+
+static int gHandled;
+
+// Each call takes 10 ticks
+static void listener( int, int )
+{
+    gHandled++;
+    gClock += 10;
+}
+
+
+template< class Manager >
+static void run( const char* name )
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+
+    // Queued at 0, 100 ... 400, dispatched from 1000 on, 10 ticks apart
+    for ( int i = 0; i < 5; i++ )
+    {
+        gClock = i * 100;
+        CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+    }
+    gClock = 1000;
+    CHECK( eventManager->processAllEvents() == 5 );
+
+    EventManager::LatencyStats stats = eventManager->getLatencyStats();
+    CHECK( stats.events == 5 );
+    CHECK( stats.minLatency == 640 && stats.maxLatency == 1000 );
+    CHECK( stats.totalLatency == 1000 + 910 + 820 + 730 + 640 );
+    CHECK( stats.latency[9] == 5 );
+
+    // The high priority level keeps its own
+    gClock = 0;
+    CHECK( eventManager->queueEvent( EventManager::kEventUser0, 0, EventManager::kHighPriority ) );
+    gClock = 3;
+    CHECK( eventManager->processEvent() == 1 );
+    EventManager::LatencyStats high = eventManager->getLatencyStats( EventManager::kHighPriority );
+    CHECK( high.events == 1 && high.minLatency == 3 && high.maxLatency == 3 && high.latency[1] == 1 );
+    CHECK( eventManager->getLatencyStats().events == 5 );
+
+    // A batch is stamped when it is queued
+    eventManager->resetLatencyStats();
+    CHECK( eventManager->getLatencyStats().events == 0 );
+    EventManager::Event batch[3] = { { EventManager::kEventUser0, 1 }, { EventManager::kEventUser0, 2 }, { EventManager::kEventUser0, 3 } };
+    gClock = 50;
+    CHECK( eventManager->queueEvents( batch, 3 ) == 3 );
+    gClock = 60;
+    CHECK( eventManager->processAllEvents() == 3 );
+    stats = eventManager->getLatencyStats();
+    CHECK( stats.events == 3 && stats.minLatency == 10 && stats.maxLatency == 30 && stats.totalLatency == 60 );
+
+    // Events nobody handles are counted too
+    eventManager->resetLatencyStats();
+    gClock = 0;
+    CHECK( eventManager->queueEvent( EventManager::kEventUser1, 0 ) );
+    gClock = 1;
+    CHECK( eventManager->processEvent() == 0 );
+    CHECK( eventManager->getLatencyStats().events == 1 );
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+// Spilled events are timed from when they were queued, not from when they move into the
+// queue:  fill the queue at 0, spill two more at 10 and 20, and handle them all at 100
+template< class Manager >
+static void spilled( const char* name )
+{
+    const int kQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    EventManager::SpilledEvent spill[4];
+    CHECK( eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kSpill, spill, 4 ) );
+
+    gClock = 0;
+    for ( int i = 0; i < kQueueSize; i++ )
+    {
+        CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+    }
+    gClock = 10;
+    CHECK( eventManager->queueEvent( EventManager::kEventUser0, 0 ) );
+    gClock = 20;
+    CHECK( eventManager->queueEvent( EventManager::kEventUser0, 0 ) );
+    CHECK( eventManager->getOverflowStats().spilled == 2 );
+
+    // Each call takes 10 ticks, so the spilled events wait ( 100 + 10 * kQueueSize ) - 10
+    // and ( 100 + 10 * ( kQueueSize + 1 ) ) - 20
+    gClock = 100;
+    CHECK( eventManager->processAllEvents() == kQueueSize + 2 );
+    EventManager::LatencyStats stats = eventManager->getLatencyStats();
+    CHECK( stats.events == static_cast<unsigned long>( kQueueSize + 2 ) );
+    CHECK( stats.minLatency == 100 && stats.maxLatency == 100 + 10 * kQueueSize - 10 );
+    unsigned long total = 0;
+    for ( int i = 0; i < kQueueSize; i++ )
+    {
+        total += 100 + 10 * i;
+    }
+    total += ( 100 + 10 * kQueueSize - 10 ) + ( 100 + 10 * ( kQueueSize + 1 ) - 20 );
+    CHECK( stats.totalLatency == total );
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+int main()
+{
+    run< EventManager >( "InterruptMask" );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+    run< EventManagerT< EventManager::SpscLockFree > >( "SpscLockFree" );
+#if EVENTMANAGER_HAS_CAS
+    run< EventManagerT< EventManager::MpscLockFree > >( "MpscLockFree" );
+#endif
+
+    spilled< EventManager >( "spilled" );
+    spilled< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "spilled, PowerOfTwoRing" );
+
+    EventManager eventManager;
+    eventManager.addListener( EventManager::kEventUser0, listener );
+
+    // A coalesced event has waited since the first event merged into it was queued
+    CHECK( eventManager.setCoalescing( EventManager::kEventUser0, EventManager::kCoalesceSum ) );
+    gClock = 0;
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 1 ) );
+    gClock = 50;
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 1 ) );
+    gClock = 100;
+    CHECK( eventManager.processAllEvents() == 1 );
+    EventManager::LatencyStats stats = eventManager.getLatencyStats();
+    CHECK( stats.events == 1 && stats.maxLatency == 100 );
+    CHECK( eventManager.setCoalescing( EventManager::kEventUser0, EventManager::kNoCoalescing ) );
+    printf( "%-30s ok\n", "coalesced" );
+
+    // Waits of 0 go in the first bin, anything too long in the last one
+    eventManager.resetLatencyStats();
+    const unsigned long waits[] = { 0, 1, 2, 3, 4, 65535, 1000000 };
+    const int bins[] = { 0, 0, 1, 1, 2, 15, 15 };
+    for ( int i = 0; i < 7; i++ )
+    {
+        gClock = 0;
+        CHECK( eventManager.queueEvent( EventManager::kEventUser0, 0 ) );
+        gClock = waits[i];
+        eventManager.processEvent();
+    }
+    stats = eventManager.getLatencyStats();
+    for ( int bin = 0; bin < EventManager::kNumLatencyBins; bin++ )
+    {
+        int expected = 0;
+        for ( int i = 0; i < 7; i++ )
+        {
+            expected += ( bins[i] == bin );
+        }
+        CHECK( stats.latency[ bin ] == static_cast<unsigned long>( expected ) );
+    }
+    CHECK( stats.minLatency == 0 && stats.maxLatency == 1000000 );
+    printf( "%-30s ok\n", "histogram" );
+
+    // Percentiles:  the top of the bin, but no more than the longest wait
+    eventManager.resetLatencyStats();
+    CHECK( EventManager::latencyPercentile( eventManager.getLatencyStats(), 90 ) == 0 );
+    for ( int i = 0; i < 100; i++ )
+    {
+        gClock = 0;
+        CHECK( eventManager.queueEvent( EventManager::kEventUser0, 0 ) );
+        gClock = ( i < 90 ) ? 5 : 300;
+        eventManager.processEvent();
+    }
+    stats = eventManager.getLatencyStats();
+    CHECK( stats.minLatency == 5 );
+    CHECK( EventManager::latencyPercentile( stats, 50 ) == 7 );
+    CHECK( EventManager::latencyPercentile( stats, 90 ) == 7 );
+    CHECK( EventManager::latencyPercentile( stats, 91 ) == 300 );
+    CHECK( EventManager::latencyPercentile( stats, 100 ) == 300 );
+    printf( "%-30s ok\n", "percentiles" );
+
+    return 0;
+}
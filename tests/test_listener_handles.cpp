@@ -0,0 +1,142 @@
+/*
+ * test_listener_handles.cpp
+ *
+ * Listener handles and tombstones:  removing a listener only marks its entry, which
+ * dispatch skips and the next addListener() clears, and a slot that is reused gets a
+ * new generation, so handles to the listener that had it stop matching.
+ *
+ * The tombstones are checked in the listener list's internals.
+ *
+ */
+
+
+// The standard headers first, so only the library's classes are opened up
+#include <set>
+
+#define private public
+#define protected public
+#include "EventManager.h"
+#undef private
+#undef protected
+
+#include "TestCheck.h"
+
+
+static int gA;
+static int gB;
+static int gC;
+
+static void onA( int, int )
+{
+    gA++;
+}
+
+static void onB( int, int )
+{
+    gB++;
+}
+
+static void onC( int, int )
+{
+    gC++;
+}
+
+
+int main()
+{
+    typedef EventManager::ListenerHandle ListenerHandle;
+
+    SizedEventManager< 4, 16, 3 > eventManager;
+    EventManager::ListenerList& list = eventManager.mListeners;
+
+    ListenerHandle h1 = eventManager.addListener( 1, onA );
+    ListenerHandle h2 = eventManager.addRangeListener( 1, 5, onB );
+    ListenerHandle h3 = eventManager.addListener( 1, onC );
+    CHECK( h1 && h2 && h3 && h1 != h2 && h2 != h3 && h1 != h3 );
+    CHECK( !eventManager.addListener( 2, onA ) && eventManager.isListenerListFull() );
+
+    // Removal leaves a tombstone in the index, which dispatch skips
+    CHECK( eventManager.removeListener( h2 ) );
+    CHECK( !eventManager.removeListener( h2 ) );
+    CHECK( list.mNumRemoved == 1 && list.mNumListeners == 3 );
+    CHECK( eventManager.numListeners() == 2 && !eventManager.isListenerListFull() );
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( gA == 1 && gB == 0 && gC == 1 );
+
+    // The next listener added clears it, and takes its slot with a new generation
+    ListenerHandle h4 = eventManager.addListener( 3, onB );
+    CHECK( list.mNumRemoved == 0 && list.mNumListeners == 3 );
+    CHECK( h4 && h4 != h2 && ( h4 & 0xff ) == ( h2 & 0xff ) );
+
+    // The old handle no longer reaches the slot
+    CHECK( !eventManager.enableListener( h2, false ) && !eventManager.isListenerEnabled( h2 ) );
+    CHECK( eventManager.enableListener( h4, false ) && !eventManager.isListenerEnabled( h4 ) );
+    CHECK( eventManager.isListenerEnabled( h1 ) );
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    CHECK( eventManager.processAllEvents() == 0 && gB == 0 );
+    CHECK( eventManager.enableListener( h4, true ) );
+
+    // Tombstones left by every kind of removal
+    CHECK( eventManager.removeListener( h1 ) );
+    CHECK( eventManager.removeListener( onC ) == 1 );
+    CHECK( list.mNumRemoved == 2 && eventManager.numListeners() == 1 );
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    CHECK( eventManager.processAllEvents() == 1 );
+    CHECK( gA == 1 && gB == 1 && gC == 1 );
+
+    // Reusing a slot over and over:  each handle is new for 255 reuses, and stops
+    // matching once it is removed
+    std::set< ListenerHandle > seen;
+    ListenerHandle previous = 0;
+    for ( int i = 0; i < 1000; i++ )
+    {
+        ListenerHandle handle = eventManager.addListener( 7, onA );
+        CHECK( handle && eventManager.numListeners() == 2 );
+        CHECK( list.mNumRemoved == 0 );
+        if ( i < 255 )
+        {
+            CHECK( seen.insert( handle ).second );
+        }
+        CHECK( !previous || !eventManager.isListenerEnabled( previous ) );
+        CHECK( eventManager.removeListener( handle ) );
+        previous = handle;
+    }
+    CHECK( list.mNumSlots == 3 );
+
+    CHECK( eventManager.addListener( 5, onA ) );
+    CHECK( eventManager.addListener( 6, onC ) );
+    CHECK( !eventManager.addListener( 8, onC ) );
+    CHECK( eventManager.queueEvent( 5, 0 ) );
+    CHECK( eventManager.queueEvent( 6, 0 ) );
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    CHECK( eventManager.processAllEvents() == 3 );
+    CHECK( gA == 2 && gB == 2 && gC == 2 );
+
+    // An empty listener matches no tombstone, and a tombstone is never removed twice
+    {
+        SizedEventManager< 4, 4, 4 > other;
+        EventManager::ListenerList& otherList = other.mListeners;
+        EventManager::EventListener none = 0;
+        CHECK( other.addListener( 1, onA ) );
+        CHECK( other.addListener( 1, onB ) );
+        CHECK( other.removeListener( 1, onA ) );
+        CHECK( !other.removeListener( 1, none ) );
+        CHECK( !other.removeListener( 1, none ) );
+        CHECK( !other.enableListener( 1, none, false ) );
+        CHECK( !other.isListenerEnabled( 1, none ) );
+        CHECK( other.removeListener( none ) == 0 );
+        CHECK( otherList.mNumRemoved == 1 && other.numListeners() == 1 );
+
+        int slot = otherList.slotOf( other.addListener( 2, onC ) );
+        CHECK( slot >= 0 && other.numListeners() == 2 );
+        otherList.removeSlot( slot );
+        otherList.removeSlot( slot );
+        CHECK( otherList.mNumRemoved == 1 && other.numListeners() == 1 );
+    }
+
+    printf( "listener handles ok\n" );
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * test_listener_layout.cpp
+ *
+ * The listener list kept as a structure of arrays:  after random adds, removals and
+ * enables on a list of the largest size, the index (mOrder and mCodes) must stay sorted
+ * and in step with the slots of the live listeners, and each listener's enabled bit must
+ * be its own.  Also checks the RAM the arrays take against kBytesPerListener.
+ *
+ * The index is checked in the listener list's internals.
+ *
+ */
+
+
+// The standard headers first, so only the library's classes are opened up
+#include <stdlib.h>
+
+#include <map>
+#include <vector>
+
+#define private public
+#define protected public
+#include "EventManager.h"
+#undef private
+#undef protected
+
+#include "TestCheck.h"
+
+
+typedef EventManager::ListenerList ListenerList;
+
+static const int kMaxListeners = 255;
+
+
+static void onEvent( int, int )
+{
+}
+
+
+// What the model knows about a live listener
+struct ModelListener
+{
+    int         match;
+    int         code;       // the code, the first code or the value
+    int         data;       // the last code or the mask
+    int         priority;
+    boolean     enabled;
+};
+
+
+template< int N >
+static void checkStorage()
+{
+    size_t arrays = N * ListenerList::kBytesPerListener + ( N + 7 ) / 8;
+    CHECK( sizeof( EventManager::ListenerStorage< N > ) >= arrays );
+    CHECK( sizeof( EventManager::ListenerStorage< N > ) < arrays + alignof( EventManager::ListenerStorage< N > ) );
+}
+
+
+// Checks the index against the model
+static void checkIndex( ListenerList& list, const std::map< EventManager::ListenerHandle, ModelListener >& model )
+{
+    CHECK( list.mNumListeners - list.mNumRemoved == static_cast<int>( model.size() ) );
+
+    std::vector<int> seen( kMaxListeners, 0 );
+    for ( int i = 0; i < list.mNumListeners; i++ )
+    {
+        int slot = list.mOrder[i];
+        CHECK( slot < list.mNumSlots );
+        seen[ slot ]++;
+
+        const ListenerList::ListenerInfo& info = list.mInfo[ slot ];
+        CHECK( ( info.match == ListenerList::kMatchCode ) == ( i < list.mNumCodeListeners ) );
+        if ( i > 0 )
+        {
+            const ListenerList::ListenerInfo& before = list.mInfo[ list.mOrder[ i - 1 ] ];
+            if ( i < list.mNumCodeListeners )
+            {
+                CHECK( ( list.mCodes[ i - 1 ] < list.mCodes[i] )
+                       || ( ( list.mCodes[ i - 1 ] == list.mCodes[i] ) && ( before.priority >= info.priority ) ) );
+            }
+            else if ( i > list.mNumCodeListeners )
+            {
+                CHECK( before.priority >= info.priority );
+            }
+        }
+    }
+
+    std::map< EventManager::ListenerHandle, ModelListener >::const_iterator it;
+    for ( it = model.begin(); it != model.end(); ++it )
+    {
+        int slot = list.slotOf( it->first );
+        CHECK( slot >= 0 && seen[ slot ] == 1 );
+        CHECK( list.isSlotEnabled( slot ) == it->second.enabled );
+
+        const ListenerList::ListenerInfo& info = list.mInfo[ slot ];
+        CHECK( info.match == it->second.match && info.priority == it->second.priority );
+        if ( info.match != ListenerList::kMatchCode )
+        {
+            CHECK( info.matchData == it->second.data );
+        }
+
+        // The entry's code in mCodes is the listener's
+        int pos = 0;
+        while ( list.mOrder[ pos ] != slot )
+        {
+            pos++;
+        }
+        CHECK( list.mCodes[ pos ] == it->second.code );
+    }
+}
+
+
+int main()
+{
+    checkStorage< 1 >();
+    checkStorage< 8 >();
+    checkStorage< 9 >();
+    checkStorage< 64 >();
+    checkStorage< kMaxListeners >();
+    printf( "%-30s ok:  %d bytes per listener\n", "storage", static_cast<int>( ListenerList::kBytesPerListener ) );
+
+    typedef SizedEventManager< 4, 4, kMaxListeners > Manager;
+    Manager* eventManager = new Manager;
+    ListenerList& list = eventManager->mListeners;
+    std::map< EventManager::ListenerHandle, ModelListener > model;
+
+    srand( 3 );
+    for ( int step = 0; step < 20000; step++ )
+    {
+        int op = rand() % 8;
+        if ( op < 4 )
+        {
+            ModelListener added;
+            added.priority = rand() % 7 - 3;
+            added.enabled = true;
+            added.code = rand() % 100 - 20;
+            EventManager::ListenerHandle handle;
+            if ( op < 2 )
+            {
+                added.match = ListenerList::kMatchCode;
+                added.data = 0;
+                handle = eventManager->addListener( added.code, onEvent, static_cast<int8_t>( added.priority ) );
+            }
+            else if ( op == 2 )
+            {
+                added.match = ListenerList::kMatchRange;
+                added.data = added.code + rand() % 10;
+                handle = eventManager->addRangeListener( added.code, added.data, onEvent, static_cast<int8_t>( added.priority ) );
+            }
+            else
+            {
+                added.match = ListenerList::kMatchMask;
+                added.data = rand() & 0xff;
+                added.code &= added.data;
+                handle = eventManager->addMaskListener( added.code, added.data, onEvent, static_cast<int8_t>( added.priority ) );
+            }
+            CHECK( ( handle != 0 ) == ( model.size() < static_cast<size_t>( kMaxListeners ) ) );
+            if ( handle )
+            {
+                CHECK( model.count( handle ) == 0 );
+                model[ handle ] = added;
+            }
+        }
+        else if ( !model.empty() )
+        {
+            std::map< EventManager::ListenerHandle, ModelListener >::iterator it = model.begin();
+            for ( int skip = rand() % model.size(); skip > 0; skip-- )
+            {
+                ++it;
+            }
+            if ( op < 6 )
+            {
+                CHECK( eventManager->removeListener( it->first ) );
+                model.erase( it );
+            }
+            else
+            {
+                it->second.enabled = !it->second.enabled;
+                CHECK( eventManager->enableListener( it->first, it->second.enabled ) );
+            }
+        }
+
+        if ( step % 10 == 0 )
+        {
+            checkIndex( list, model );
+        }
+    }
+
+    printf( "%-30s ok\n", "index" );
+    delete eventManager;
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * test_listener_priorities.cpp
+ *
+ * Listeners for an event are called in order of decreasing priority, in the order they
+ * were added when their priorities are equal, and a consuming listener that returns true
+ * stops the event there (the default listener included).  Checked on a fixed set of
+ * listeners, then against a model with random priorities.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+// Each listener appends its letter to the log
+static std::string gLog;
+
+static void onA( int, int )
+{
+    gLog += 'a';
+}
+
+static void onB( int, int )
+{
+    gLog += 'b';
+}
+
+static void onC( int, int )
+{
+    gLog += 'c';
+}
+
+static void onDefault( int, int )
+{
+    gLog += 'd';
+}
+
+// Consumes events whose parameter is not 0
+static boolean onSafety( int, int param )
+{
+    gLog += 's';
+    return param != 0;
+}
+
+struct Filter
+{
+    // Consumes events whose parameter is 2
+    boolean onEvent( int, int param )
+    {
+        gLog += 'f';
+        return param == 2;
+    }
+};
+
+
+// For the model:  listener number *context is called, and consumes the event if the
+// parameter is its number
+static std::vector<int> gCalls;
+
+static boolean onNumbered( void* context, int, int param )
+{
+    int number = *static_cast<int*>( context );
+    gCalls.push_back( number );
+    return param == number;
+}
+
+struct ModelListener
+{
+    int     number;
+    int     priority;
+};
+
+static bool higherPriority( const ModelListener& a, const ModelListener& b )
+{
+    return a.priority > b.priority;
+}
+
+
+static void fixed()
+{
+    typedef EventManager::Delegate Delegate;
+
+    EventManager eventManager;
+    Filter filter;
+
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onA ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onB, -5 ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onSafety, 100 ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, onC ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser0, Delegate::bind< Filter, &Filter::onEvent >( &filter ), 10 ) );
+    CHECK( eventManager.addListener( EventManager::kEventUser1, onC ) );
+    eventManager.setDefaultListener( onDefault );
+
+    // Not consumed:  everyone, by priority, a and c in the order they were added
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 0 ) );
+    CHECK( eventManager.processEvent() == 5 );
+    CHECK( gLog == "sfacb" );
+
+    // Consumed by the first listener:  no one else, not even the default listener
+    gLog.clear();
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 2 ) );
+    CHECK( eventManager.processEvent() == 1 );
+    CHECK( gLog == "s" );
+
+    gLog.clear();
+    CHECK( eventManager.removeListener( EventManager::kEventUser0, onSafety ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 2 ) );
+    CHECK( eventManager.processEvent() == 1 );
+    CHECK( gLog == "f" );
+
+    // A disabled consumer consumes nothing
+    gLog.clear();
+    CHECK( eventManager.enableListener( EventManager::kEventUser0, Delegate::bind< Filter, &Filter::onEvent >( &filter ), false ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventUser0, 2 ) );
+    CHECK( eventManager.processEvent() == 3 );
+    CHECK( gLog == "acb" );
+
+    // Other codes are not affected
+    gLog.clear();
+    CHECK( eventManager.queueEvent( EventManager::kEventUser1, 2 ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventUser2, 2 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( gLog == "cd" );
+
+    printf( "%-30s ok\n", "fixed listeners" );
+}
+
+
+static void model()
+{
+    const int kListeners = 12;
+
+    srand( 1 );
+    for ( int round = 0; round < 500; round++ )
+    {
+        SizedEventManager< 4, 4, kListeners > eventManager;
+        static int numbers[ kListeners ];
+        std::vector< ModelListener > listeners;
+
+        for ( int i = 0; i < kListeners; i++ )
+        {
+            numbers[i] = i;
+            ModelListener added = { i, rand() % 5 - 2 };
+            if ( rand() % 8 == 0 )
+            {
+                added.priority = ( rand() % 2 ) ? 127 : -128;
+            }
+            CHECK( eventManager.addListener( EventManager::kEventUser0, onNumbered, &numbers[i], static_cast<int8_t>( added.priority ) ) );
+            listeners.push_back( added );
+        }
+        std::stable_sort( listeners.begin(), listeners.end(), higherPriority );
+
+        // -1 is consumed by no one
+        for ( int consumer = -1; consumer < kListeners; consumer++ )
+        {
+            std::vector<int> expected;
+            for ( size_t i = 0; i < listeners.size(); i++ )
+            {
+                expected.push_back( listeners[i].number );
+                if ( listeners[i].number == consumer )
+                {
+                    break;
+                }
+            }
+
+            gCalls.clear();
+            CHECK( eventManager.queueEvent( EventManager::kEventUser0, consumer ) );
+            CHECK( eventManager.processEvent() == static_cast<int>( expected.size() ) );
+            CHECK( gCalls == expected );
+        }
+    }
+
+    printf( "%-30s ok\n", "random priorities" );
+}
+
+
+int main()
+{
+    fixed();
+    model();
+    return 0;
+}
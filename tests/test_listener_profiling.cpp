@@ -0,0 +1,110 @@
+/*
+ * test_listener_profiling.cpp
+ *
+ * Listener profiling (EVENTMANAGER_LISTENER_PROFILING):  each listener entry, single
+ * code, range or mask, counts its own calls and times, only for the calls it actually
+ * gets, and starts afresh when it is added or the profiles are reset.  The times come
+ * from micros(), so only their lower bounds are checked exactly.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <unistd.h>
+
+#include <string>
+
+
+static void onFast( int, int )
+{
+}
+
+// Takes param microseconds (at least)
+static void onSlow( int, int param )
+{
+    usleep( param );
+}
+
+static boolean onConsume( int, int )
+{
+    return true;
+}
+
+
+// Keeps what is printed to it
+class StringPrint : public Print
+{
+public:
+
+    virtual size_t write( uint8_t c )
+    {
+        text += static_cast<char>( c );
+        return 1;
+    }
+
+    std::string text;
+};
+
+
+int main()
+{
+    // Room for exactly the listeners below, so that a removed one's slot is reused
+    SizedEventManager< 8, 8, 4 > eventManager;
+    EventManager::ListenerProfile profile;
+
+    EventManager::ListenerHandle fast = eventManager.addListener( 1, onFast );
+    EventManager::ListenerHandle slow = eventManager.addRangeListener( 1, 3, onSlow );
+    EventManager::ListenerHandle mask = eventManager.addMaskListener( 0x10, 0xF0, onFast );
+    CHECK( fast && slow && mask );
+
+    CHECK( eventManager.getListenerProfile( slow, &profile ) );
+    CHECK( profile.calls == 0 && profile.totalMicros == 0 && profile.maxMicros == 0 );
+
+    CHECK( eventManager.queueEvent( 1, 2000 ) );
+    CHECK( eventManager.queueEvent( 2, 5000 ) );
+    CHECK( eventManager.queueEvent( 3, 100 ) );
+    CHECK( eventManager.queueEvent( 0x13, 0 ) );
+    CHECK( eventManager.queueEvent( 0x14, 0 ) );
+    CHECK( eventManager.processAllEvents() == 6 );
+
+    CHECK( eventManager.getListenerProfile( fast, &profile ) );
+    CHECK( profile.calls == 1 && profile.maxMicros < 2000 );
+    CHECK( eventManager.getListenerProfile( slow, &profile ) );
+    CHECK( profile.calls == 3 && profile.maxMicros >= 5000 );
+    CHECK( profile.totalMicros >= 7100 && profile.totalMicros >= profile.maxMicros );
+    CHECK( eventManager.getListenerProfile( mask, &profile ) );
+    CHECK( profile.calls == 2 );
+
+    // One line per listener, with its codes and its call count
+    StringPrint out;
+    eventManager.dumpListenerProfiles( out );
+    CHECK( out.text.find( "\t1\t1\t" ) != std::string::npos );
+    CHECK( out.text.find( "\t1..3\t3\t" ) != std::string::npos );
+    CHECK( out.text.find( "\t10/f0\t2\t" ) != std::string::npos );
+
+    // A disabled listener, or one after a consuming listener, is not called or counted
+    eventManager.resetListenerProfiles();
+    CHECK( eventManager.getListenerProfile( slow, &profile ) );
+    CHECK( profile.calls == 0 && profile.totalMicros == 0 && profile.maxMicros == 0 );
+    CHECK( eventManager.enableListener( slow, false ) );
+    EventManager::ListenerHandle consume = eventManager.addListener( 0x13, onConsume, 1 );
+    CHECK( eventManager.queueEvent( 1, 1000 ) );
+    CHECK( eventManager.queueEvent( 0x13, 0 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( eventManager.getListenerProfile( fast, &profile ) && profile.calls == 1 );
+    CHECK( eventManager.getListenerProfile( slow, &profile ) && profile.calls == 0 );
+    CHECK( eventManager.getListenerProfile( mask, &profile ) && profile.calls == 0 );
+    CHECK( eventManager.getListenerProfile( consume, &profile ) && profile.calls == 1 );
+
+    // A removed listener has no profile, and the listener that takes its slot starts at 0
+    CHECK( eventManager.removeListener( slow ) );
+    CHECK( !eventManager.getListenerProfile( slow, &profile ) );
+    EventManager::ListenerHandle reused = eventManager.addListener( 5, onFast );
+    CHECK( ( reused & 0xff ) == ( slow & 0xff ) );
+    CHECK( eventManager.getListenerProfile( reused, &profile ) && profile.calls == 0 && profile.totalMicros == 0 );
+
+    printf( "listener profiling ok\n" );
+    return 0;
+}
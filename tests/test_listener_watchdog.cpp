@@ -0,0 +1,114 @@
+/*
+ * test_listener_watchdog.cpp
+ *
+ * The slow listener watchdog (EVENTMANAGER_LISTENER_WATCHDOG):  the hook is called once
+ * for each listener call, the default listener's included, that takes longer than the
+ * budget, with the listener's handle, the event code and the time taken, and never when
+ * there is no budget.  The hook may remove the listener it is told about.
+ *
+ * The times come from micros(), so the slow listeners take well over the budget and the
+ * fast ones nothing at all.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <unistd.h>
+
+#include <vector>
+
+
+static const unsigned long kBudget = 1000;
+
+static EventManager* gEventManager;
+
+struct Overrun
+{
+    EventManager::ListenerHandle    listener;
+    int                             eventCode;
+    unsigned long                   elapsedMicros;
+};
+
+static std::vector< Overrun > gOverruns;
+static boolean gRemoveOverrunning;
+
+
+static void onOverrun( EventManager::ListenerHandle listener, int eventCode, unsigned long elapsedMicros )
+{
+    Overrun overrun = { listener, eventCode, elapsedMicros };
+    gOverruns.push_back( overrun );
+    if ( gRemoveOverrunning && listener )
+    {
+        CHECK( gEventManager->removeListener( listener ) );
+    }
+}
+
+static void onFast( int, int )
+{
+}
+
+// Takes param microseconds (at least)
+static void onSlow( int, int param )
+{
+    usleep( param );
+}
+
+
+int main()
+{
+    EventManager eventManager;
+    gEventManager = &eventManager;
+
+    CHECK( eventManager.addListener( 1, onFast ) );
+    EventManager::ListenerHandle slow = eventManager.addListener( 2, onSlow );
+    EventManager::ListenerHandle slowRange = eventManager.addRangeListener( 2, 3, onSlow );
+    eventManager.setDefaultListener( onSlow );
+
+    // No budget, no hook
+    CHECK( eventManager.queueEvent( 2, 3000 ) );
+    eventManager.processEvent();
+    CHECK( gOverruns.empty() );
+
+    // Within the budget
+    eventManager.setListenerBudget( kBudget, onOverrun );
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    eventManager.processAllEvents();
+    CHECK( gOverruns.empty() );
+
+    // Each listener that goes over is reported on its own
+    CHECK( eventManager.queueEvent( 2, 3000 ) );
+    CHECK( eventManager.processEvent() == 2 );
+    CHECK( gOverruns.size() == 2 );
+    CHECK( gOverruns[0].listener == slow && gOverruns[0].eventCode == 2 && gOverruns[0].elapsedMicros >= 3000 );
+    CHECK( gOverruns[1].listener == slowRange && gOverruns[1].eventCode == 2 && gOverruns[1].elapsedMicros >= 3000 );
+
+    // The default listener is reported with handle 0
+    gOverruns.clear();
+    CHECK( eventManager.queueEvent( 7, 2000 ) );
+    eventManager.processEvent();
+    CHECK( gOverruns.size() == 1 );
+    CHECK( gOverruns[0].listener == 0 && gOverruns[0].eventCode == 7 && gOverruns[0].elapsedMicros >= 2000 );
+
+    // The hook can remove the listener that went over, during the dispatch
+    gOverruns.clear();
+    gRemoveOverrunning = true;
+    CHECK( eventManager.queueEvent( 2, 2000 ) );
+    eventManager.processEvent();
+    CHECK( gOverruns.size() == 2 );
+    CHECK( !eventManager.isListenerEnabled( slow ) && !eventManager.isListenerEnabled( slowRange ) );
+    CHECK( eventManager.numListeners() == 1 );
+    gRemoveOverrunning = false;
+
+    // A budget of 0 turns the check off again
+    gOverruns.clear();
+    eventManager.setListenerBudget( 0, onOverrun );
+    CHECK( eventManager.queueEvent( 5, 3000 ) );
+    eventManager.processEvent();
+    CHECK( gOverruns.empty() );
+
+    printf( "listener watchdog ok\n" );
+    return 0;
+}
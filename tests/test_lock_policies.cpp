@@ -0,0 +1,195 @@
+/*
+ * test_lock_policies.cpp
+ *
+ * Checks that each lock policy keeps its queues consistent when events are queued
+ * from the contexts it is meant for:  NoLock from the processing context only, the
+ * other policies from several threads at once (and InterruptMask from a signal
+ * handler as well).  Every event must arrive exactly once, and each producer's
+ * events of each priority in the order it queued them.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+static const int kMaxProducers = 8;
+static const int kEventsPerProducer = 50000;
+static const int kSequenceBits = 20;
+
+// Odd sequence numbers are queued with high priority, even ones with low priority, so
+// the next expected number of each parity is tracked separately.  The signal handler
+// is producer number kMaxProducers.
+static int gNext[ kMaxProducers + 1 ][ 2 ];
+// Events handled from the producer threads (not the signal handler)
+static long gHandled;
+
+
+static void listener( int, int param )
+{
+    int producer = param >> kSequenceBits;
+    int sequence = param & ( ( 1 << kSequenceBits ) - 1 );
+    CHECK( producer <= kMaxProducers );
+    CHECK( sequence == gNext[ producer ][ sequence & 1 ] );
+    gNext[ producer ][ sequence & 1 ] += 2;
+    if ( producer < kMaxProducers )
+    {
+        gHandled++;
+    }
+}
+
+
+static void reset()
+{
+    for ( int p = 0; p <= kMaxProducers; p++ )
+    {
+        gNext[p][0] = 0;
+        gNext[p][1] = 1;
+    }
+    gHandled = 0;
+}
+
+
+// Queues numbered events from a signal handler into Manager's high priority queue
+template< class Manager >
+struct SignalProducer
+{
+    static Manager* target;
+    static volatile sig_atomic_t produced;
+
+    static void onTimer( int )
+    {
+        int savedErrno = errno;
+        if ( target->queueEvent( EventManager::kEventUser0, ( kMaxProducers << kSequenceBits ) | ( 2 * produced + 1 ), EventManager::kHighPriority ) )
+        {
+            produced = produced + 1;
+        }
+        errno = savedErrno;
+    }
+
+    static void start( Manager* eventManager )
+    {
+        target = eventManager;
+        produced = 0;
+        signal( SIGALRM, onTimer );
+        itimerval timer = { { 0, 100 }, { 0, 100 } };
+        setitimer( ITIMER_REAL, &timer, 0 );
+    }
+
+    static int stop()
+    {
+        itimerval timer = { { 0, 0 }, { 0, 0 } };
+        setitimer( ITIMER_REAL, &timer, 0 );
+        return produced;
+    }
+};
+
+template< class Manager > Manager* SignalProducer< Manager >::target;
+template< class Manager > volatile sig_atomic_t SignalProducer< Manager >::produced;
+
+
+template< class Manager >
+static void run( const char* name, int numProducers, boolean withSignals )
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    reset();
+
+    std::atomic<bool> go( false );
+    std::vector<std::thread> producers;
+    for ( int p = 0; p < numProducers; p++ )
+    {
+        producers.push_back( std::thread( [ eventManager, &go, p ]
+        {
+            // The "interrupt" only ever interrupts the processing thread, like loop() on its core
+            sigset_t alarm;
+            sigemptyset( &alarm );
+            sigaddset( &alarm, SIGALRM );
+            pthread_sigmask( SIG_BLOCK, &alarm, 0 );
+
+            while ( !go )
+            {
+                std::this_thread::yield();
+            }
+            for ( int i = 0; i < kEventsPerProducer; i++ )
+            {
+                // Alternate priorities, so both queues are contended
+                EventManager::EventPriority pri = ( i & 1 ) ? EventManager::kHighPriority : EventManager::kLowPriority;
+                while ( !eventManager->queueEvent( EventManager::kEventUser0, ( p << kSequenceBits ) | i, pri ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    if ( withSignals )
+    {
+        SignalProducer< Manager >::start( eventManager );
+    }
+    go = true;
+
+    long expected = static_cast<long>( numProducers ) * kEventsPerProducer;
+    while ( gHandled < expected )
+    {
+        if ( !eventManager->processEvent() )
+        {
+            std::this_thread::yield();
+        }
+    }
+    for ( size_t i = 0; i < producers.size(); i++ )
+    {
+        producers[i].join();
+    }
+
+    int signalProduced = withSignals ? SignalProducer< Manager >::stop() : 0;
+    eventManager->processAllEvents();
+    CHECK( gNext[ kMaxProducers ][1] == 2 * signalProduced + 1 );
+    CHECK( !withSignals || signalProduced > 0 );
+
+    for ( int p = 0; p < numProducers; p++ )
+    {
+        CHECK( gNext[p][0] == kEventsPerProducer && gNext[p][1] == kEventsPerProducer + 1 );
+    }
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kHighPriority ) );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kLowPriority ) );
+
+    printf( "%-30s %d producers%s:  ok\n", name, numProducers, withSignals ? " and a signal handler" : "" );
+
+    delete eventManager;
+}
+
+
+int main()
+{
+    // NoLock:  queued and processed by the same thread
+    {
+        EventManagerT< EventManager::NoLock > eventManager;
+        eventManager.addListener( EventManager::kEventUser0, listener );
+        reset();
+        for ( int i = 0; i < 1000; i++ )
+        {
+            CHECK( eventManager.queueEvent( EventManager::kEventUser0, 2 * i ) );
+            CHECK( eventManager.processEvent() == 1 );
+        }
+        CHECK( gNext[0][0] == 2000 );
+        printf( "%-30s ok\n", "NoLock" );
+    }
+
+    run< EventManagerT< EventManager::MutexLock > >( "MutexLock", 4, false );
+    run< EventManagerT< EventManager::SpinLock > >( "SpinLock", 4, false );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::SpinLock > > >( "PowerOfTwoRing<SpinLock>", 4, false );
+    run< EventManagerT< EventManager::InterruptMask > >( "InterruptMask", 4, true );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>", 4, true );
+
+    return 0;
+}
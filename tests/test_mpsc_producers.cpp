@@ -0,0 +1,110 @@
+/*
+ * test_mpsc_producers.cpp
+ *
+ * Several std::threads queue events into an MpscLockFree manager at once while the
+ * main thread processes them.  Each producer numbers its events, so the test checks
+ * that every event arrives exactly once and that each producer's events arrive in
+ * the order it queued them.  The throughput for each number of producers is printed.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+typedef SizedEventManager< 64, 64, 1, EventManagerBase::MpscLockFree > MpscEventManager;
+
+static const int kMaxProducers = 16;
+static const int kEventsPerProducer = 100000;
+
+// The parameter of each event:  the producer in the top bits, its sequence number below
+static const int kSequenceBits = 20;
+
+static int gNext[ kMaxProducers ];
+static long gHandled;
+
+
+static void listener( int, int param )
+{
+    int producer = param >> kSequenceBits;
+    int sequence = param & ( ( 1 << kSequenceBits ) - 1 );
+    CHECK( producer < kMaxProducers );
+    CHECK( sequence == gNext[ producer ] );
+    gNext[ producer ]++;
+    gHandled++;
+}
+
+
+static void run( int numProducers )
+{
+    MpscEventManager* eventManager = new MpscEventManager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+
+    for ( int p = 0; p < kMaxProducers; p++ )
+    {
+        gNext[p] = 0;
+    }
+    gHandled = 0;
+
+    std::atomic<bool> go( false );
+    std::vector<std::thread> producers;
+    for ( int p = 0; p < numProducers; p++ )
+    {
+        producers.push_back( std::thread( [ eventManager, &go, p ]
+        {
+            while ( !go )
+            {
+                std::this_thread::yield();
+            }
+            for ( int i = 0; i < kEventsPerProducer; i++ )
+            {
+                while ( !eventManager->queueEvent( EventManager::kEventUser0, ( p << kSequenceBits ) | i ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+        } ) );
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    go = true;
+
+    long expected = static_cast<long>( numProducers ) * kEventsPerProducer;
+    while ( gHandled < expected )
+    {
+        if ( !eventManager->processAllEvents() )
+        {
+            std::this_thread::yield();
+        }
+    }
+    for ( size_t i = 0; i < producers.size(); i++ )
+    {
+        producers[i].join();
+    }
+
+    double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+    printf( "%2d producers:  %ld events in %.3f s  (%.2f million events/s)\n", numProducers, gHandled, seconds, gHandled / seconds / 1e6 );
+
+    for ( int p = 0; p < numProducers; p++ )
+    {
+        CHECK( gNext[p] == kEventsPerProducer );
+    }
+    CHECK( eventManager->isEventQueueEmpty() );
+
+    delete eventManager;
+}
+
+
+int main()
+{
+    for ( int numProducers = 1; numProducers <= kMaxProducers; numProducers *= 2 )
+    {
+        run( numProducers );
+    }
+    return 0;
+}
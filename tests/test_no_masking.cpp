@@ -0,0 +1,79 @@
+/*
+ * test_no_masking.cpp
+ *
+ * Built as for a target without atomic read-modify-write instructions (AVR, Cortex-M0,
+ * ESP8266), where shared state cannot always be updated atomically:  managers with the
+ * NoLock and SpscLockFree policies must still never suppress interrupts, from queueing
+ * or from processing, on any priority level.
+ *
+ * On a host InterruptMask blocks signals with pthread_sigmask(), which this test
+ * replaces with a version that counts the calls.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <signal.h>
+
+
+static int gMaskCalls;
+
+extern "C" int pthread_sigmask( int how, const sigset_t* set, sigset_t* oldSet ) __THROW
+{
+    gMaskCalls++;
+    return sigprocmask( how, set, oldSet );
+}
+
+
+static int gHandled;
+
+static void listener( int, int )
+{
+    gHandled++;
+}
+
+
+template< class Manager >
+static int masksTaken()
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    gHandled = 0;
+    gMaskCalls = 0;
+
+    for ( int round = 0; round < 3; round++ )
+    {
+        for ( int level = 0; level < EventManager::kMaxPriorityLevels; level++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, level, static_cast< EventManager::EventPriority >( level ) ) );
+        }
+        EventManager::Event batch[2] = { { EventManager::kEventUser0, 1 }, { EventManager::kEventUser0, 2 } };
+        CHECK( eventManager->queueEvents( batch, 2 ) == 2 );
+        CHECK( eventManager->processEvent() == 1 );
+        eventManager->processAllEvents();
+        CHECK( eventManager->isEventQueueEmpty() && eventManager->isEventQueueEmpty( EventManager::kHighPriority ) );
+    }
+    CHECK( gHandled == 3 * ( EventManager::kMaxPriorityLevels + 2 ) );
+
+    delete eventManager;
+    return gMaskCalls;
+}
+
+
+int main()
+{
+    CHECK( !EVENTMANAGER_HAS_ATOMIC_RMW );
+
+    CHECK( ( masksTaken< SizedEventManager< 4, 16, 1, EventManager::NoLock, 4 > >() == 0 ) );
+    CHECK( ( masksTaken< SizedEventManager< 4, 16, 1, EventManager::PowerOfTwoRing< EventManager::NoLock >, 8 > >() == 0 ) );
+    CHECK( ( masksTaken< SizedEventManager< 4, 16, 1, EventManager::SpscLockFree, 4 > >() == 0 ) );
+    CHECK( ( masksTaken< SizedEventManager< 4, 16, 1, EventManager::SpscLockFree, 8 > >() == 0 ) );
+
+    // The default policy does suppress them, so the count is taken
+    CHECK( ( masksTaken< SizedEventManager< 4, 16, 1 > >() > 0 ) );
+
+    printf( "no masking ok\n" );
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * test_overflow_policies.cpp
+ *
+ * Fills queues past their capacity under each overflow policy, and checks which
+ * events are handled, in what order, and what the overflow statistics count.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <vector>
+
+
+static const int kQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+
+static std::vector<int> gHandled;
+
+
+static void listener( int, int param )
+{
+    gHandled.push_back( param );
+}
+
+
+template< class Manager >
+static Manager* newManager()
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    eventManager->addListener( EventManager::kEventUser1, listener );
+    gHandled.clear();
+    return eventManager;
+}
+
+
+template< class Manager >
+static void run( const char* name )
+{
+    // kDropNewest (the default):  the events that do not fit are rejected
+    {
+        Manager* eventManager = newManager< Manager >();
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) == ( i < kQueueSize ) );
+        }
+        CHECK( eventManager->getOverflowStats().droppedNewest == 2 );
+        eventManager->processAllEvents();
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize && gHandled.back() == kQueueSize - 1 );
+        delete eventManager;
+    }
+
+    // kDropOldest:  the oldest events make room for the new ones
+    {
+        Manager* eventManager = newManager< Manager >();
+        CHECK( eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kDropOldest ) );
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+        }
+        CHECK( eventManager->getOverflowStats().droppedOldest == 2 );
+        eventManager->processAllEvents();
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize );
+        CHECK( gHandled.front() == 2 && gHandled.back() == kQueueSize + 1 );
+        delete eventManager;
+    }
+
+    // kOverwriteNewest:  the newest event waiting is replaced
+    {
+        Manager* eventManager = newManager< Manager >();
+        CHECK( eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kOverwriteNewest ) );
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) );
+        }
+        CHECK( eventManager->getOverflowStats().overwritten == 2 );
+        eventManager->processAllEvents();
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize );
+        CHECK( gHandled[ kQueueSize - 2 ] == kQueueSize - 2 && gHandled.back() == kQueueSize + 1 );
+        delete eventManager;
+    }
+
+    // kSpill:  events that do not fit wait in the spill buffer, in order, until it fills too
+    {
+        Manager* eventManager = newManager< Manager >();
+        EventManager::SpilledEvent spill[4];
+        CHECK( !eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kSpill ) );
+        CHECK( eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kSpill, spill, 4 ) );
+
+        for ( int i = 0; i < kQueueSize + 6; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, i ) == ( i < kQueueSize + 4 ) );
+        }
+        EventManager::OverflowStats stats = eventManager->getOverflowStats();
+        CHECK( stats.spilled == 4 && stats.droppedNewest == 2 );
+        CHECK( eventManager->getNumEventsInQueue() == kQueueSize + 4 );
+
+        // The policy cannot change while spilled events are waiting
+        CHECK( !eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kDropNewest ) );
+
+        // Events queued once there is room again come after the spilled ones
+        eventManager->processEvent();
+        eventManager->processEvent();
+        CHECK( eventManager->queueEvent( EventManager::kEventUser0, 100 ) );
+        eventManager->processAllEvents();
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize + 5 );
+        for ( int i = 0; i < kQueueSize + 4; i++ )
+        {
+            CHECK( gHandled[i] == i );
+        }
+        CHECK( gHandled.back() == 100 );
+
+        eventManager->resetOverflowStats();
+        CHECK( eventManager->getOverflowStats().spilled == 0 );
+
+        // Coalescing reaches into the spill buffer
+        CHECK( eventManager->setCoalescing( EventManager::kEventUser1, EventManager::kCoalesceSum ) );
+        gHandled.clear();
+        for ( int i = 0; i < kQueueSize; i++ )
+        {
+            eventManager->queueEvent( EventManager::kEventUser0, i );
+        }
+        CHECK( eventManager->queueEvent( EventManager::kEventUser1, 5 ) );
+        CHECK( eventManager->queueEvent( EventManager::kEventUser1, 6 ) );
+        CHECK( eventManager->getNumEventsInQueue() == kQueueSize + 1 );
+        eventManager->processAllEvents();
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize + 1 && gHandled.back() == 11 );
+
+        CHECK( eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kDropNewest ) );
+        delete eventManager;
+    }
+
+    printf( "%-30s ok\n", name );
+}
+
+
+int main()
+{
+    run< EventManager >( "InterruptMask" );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+
+    // The lock-free queues only drop the newest events, from single events and batches alike
+    {
+        EventManagerT< EventManager::SpscLockFree >* eventManager = newManager< EventManagerT< EventManager::SpscLockFree > >();
+        CHECK( !eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kDropOldest ) );
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            eventManager->queueEvent( EventManager::kEventUser0, i );
+        }
+        EventManager::Event batch[3] = { { EventManager::kEventUser0, 1 }, { EventManager::kEventUser0, 2 }, { EventManager::kEventUser0, 3 } };
+        CHECK( eventManager->queueEvents( batch, 3 ) == 0 );
+        CHECK( eventManager->getOverflowStats().droppedNewest == 5 );
+        eventManager->resetOverflowStats();
+        CHECK( eventManager->getOverflowStats().droppedNewest == 0 );
+        delete eventManager;
+        printf( "%-30s ok\n", "SpscLockFree" );
+    }
+#if EVENTMANAGER_HAS_CAS
+    {
+        EventManagerT< EventManager::MpscLockFree >* eventManager = newManager< EventManagerT< EventManager::MpscLockFree > >();
+        EventManager::SpilledEvent spill[4];
+        CHECK( !eventManager->setOverflowPolicy( EventManager::kLowPriority, EventManager::kSpill, spill, 4 ) );
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            eventManager->queueEvent( EventManager::kEventUser0, i );
+        }
+        CHECK( eventManager->getOverflowStats().droppedNewest == 2 );
+        delete eventManager;
+        printf( "%-30s ok\n", "MpscLockFree" );
+    }
+#endif
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * test_priority_levels.cpp
+ *
+ * Managers with more than two priority levels:  each level has its own queue, events are
+ * handled highest level first and in the order queued within a level, an event nobody
+ * handles lets the next lower level have a turn, and levels a manager does not have fall
+ * to its lowest.  Checked on fixed cases, then against a model with random events, for
+ * each kind of queue.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <stdlib.h>
+
+#include <deque>
+#include <vector>
+
+
+// The events handled, as code * 1000 + param
+static std::vector<int> gHandled;
+
+static void listener( int eventCode, int param )
+{
+    gHandled.push_back( eventCode * 1000 + param );
+}
+
+
+template< class LockPolicy >
+static void fixed( const char* name )
+{
+    typedef SizedEventManager< 4, 4, 4, LockPolicy, 4 > Manager;
+    Manager* eventManager = new Manager;
+    for ( int code = 1; code <= 4; code++ )
+    {
+        eventManager->addListener( code, listener );
+    }
+
+    // Levels beyond the fourth are the fourth
+    gHandled.clear();
+    CHECK( eventManager->queueEvent( 4, 0, EventManager::kLowPriority ) );
+    CHECK( eventManager->queueEvent( 3, 0, EventManager::kPriority2 ) );
+    CHECK( eventManager->queueEvent( 2, 0, EventManager::kPriority1 ) );
+    CHECK( eventManager->queueEvent( 1, 0, EventManager::kHighPriority ) );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kPriority3 ) == 1 );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kPriority7 ) == 1 );
+    for ( int i = 0; i < 4; i++ )
+    {
+        CHECK( eventManager->processEvent() == 1 );
+    }
+    CHECK( gHandled.size() == 4 && gHandled[0] == 1000 && gHandled[1] == 2000 && gHandled[2] == 3000 && gHandled[3] == 4000 );
+    CHECK( eventManager->processEvent() == 0 );
+
+    // Unhandled events let the next level have a turn, one event per level
+    gHandled.clear();
+    CHECK( eventManager->queueEvent( 99, 0, EventManager::kPriority0 ) );
+    CHECK( eventManager->queueEvent( 98, 0, EventManager::kPriority1 ) );
+    CHECK( eventManager->queueEvent( 2, 0, EventManager::kPriority2 ) );
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( gHandled.size() == 1 && gHandled[0] == 2000 );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kPriority0 ) && eventManager->isEventQueueEmpty( EventManager::kPriority1 ) );
+
+    // Each level has the capacity it was given
+    for ( int i = 0; i < 4; i++ )
+    {
+        CHECK( eventManager->queueEvent( 1, i, EventManager::kPriority0 ) );
+        CHECK( eventManager->queueEvent( 2, i, EventManager::kPriority2 ) );
+    }
+    CHECK( !eventManager->queueEvent( 1, 0, EventManager::kPriority0 ) );
+    CHECK( !eventManager->queueEvent( 2, 0, EventManager::kPriority2 ) );
+    CHECK( eventManager->queueEvent( 3, 0, EventManager::kPriority1 ) );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kPriority1 ) == 1 );
+    eventManager->processAllEvents();
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+template< class LockPolicy >
+static void model( const char* name )
+{
+    const int kLevels = 8;
+    const int kQueueSize = 8;
+
+    typedef SizedEventManager< kQueueSize, kQueueSize, 1, LockPolicy, kLevels > Manager;
+    Manager* eventManager = new Manager;
+    eventManager->setDefaultListener( listener );
+
+    std::deque<int> queued[ kLevels ];
+    gHandled.clear();
+    srand( 5 );
+    for ( int step = 0; step < 50000; step++ )
+    {
+        int op = rand() % 4;
+        if ( op < 2 )
+        {
+            int level = rand() % kLevels;
+            int param = step % 1000;
+            boolean fits = queued[ level ].size() < static_cast<size_t>( kQueueSize );
+            CHECK( eventManager->queueEvent( level + 1, param, static_cast< EventManager::EventPriority >( level ) ) == fits );
+            if ( fits )
+            {
+                queued[ level ].push_back( ( level + 1 ) * 1000 + param );
+            }
+        }
+        else
+        {
+            // processEvent() takes the oldest event of the highest level, processAllEvents()
+            // everything, highest level first
+            std::vector<int> expected;
+            for ( int level = 0; level < kLevels; level++ )
+            {
+                while ( !queued[ level ].empty() )
+                {
+                    expected.push_back( queued[ level ].front() );
+                    queued[ level ].pop_front();
+                    if ( op == 2 )
+                    {
+                        break;
+                    }
+                }
+                if ( op == 2 && !expected.empty() )
+                {
+                    break;
+                }
+            }
+
+            gHandled.clear();
+            int handled = ( op == 2 ) ? eventManager->processEvent() : eventManager->processAllEvents();
+            CHECK( handled == static_cast<int>( expected.size() ) );
+            CHECK( gHandled == expected );
+        }
+
+        for ( int level = 0; level < kLevels; level++ )
+        {
+            EventManager::EventPriority pri = static_cast< EventManager::EventPriority >( level );
+            CHECK( eventManager->getNumEventsInQueue( pri ) == static_cast<int>( queued[ level ].size() ) );
+            CHECK( eventManager->isEventQueueEmpty( pri ) == queued[ level ].empty() );
+        }
+    }
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+int main()
+{
+    fixed< EventManager::InterruptMask >( "InterruptMask" );
+    fixed< EventManager::PowerOfTwoRing< EventManager::InterruptMask > >( "PowerOfTwoRing<InterruptMask>" );
+    fixed< EventManager::SpscLockFree >( "SpscLockFree" );
+#if EVENTMANAGER_HAS_CAS
+    fixed< EventManager::MpscLockFree >( "MpscLockFree" );
+#endif
+
+    model< EventManager::InterruptMask >( "InterruptMask, 8 levels" );
+    model< EventManager::PowerOfTwoRing< EventManager::InterruptMask > >( "PowerOfTwoRing, 8 levels" );
+    model< EventManager::SpscLockFree >( "SpscLockFree, 8 levels" );
+#if EVENTMANAGER_HAS_CAS
+    model< EventManager::MpscLockFree >( "MpscLockFree, 8 levels" );
+#endif
+
+    // The default two levels:  everything but the high priority queue is low priority
+    EventManager eventManager;
+    eventManager.addListener( 1, listener );
+    gHandled.clear();
+    CHECK( eventManager.queueEvent( 1, 5, EventManager::kPriority3 ) );
+    CHECK( eventManager.queueEvent( 1, 6, EventManager::kHighPriority ) );
+    CHECK( eventManager.getNumEventsInQueue( EventManager::kLowPriority ) == 1 );
+    CHECK( eventManager.processEvent() == 1 );
+    CHECK( gHandled.size() == 1 && gHandled[0] == 1006 );
+    CHECK( eventManager.getNumEventsInQueue() == 1 && eventManager.isEventQueueEmpty( EventManager::kHighPriority ) );
+    printf( "%-30s ok\n", "two levels" );
+
+    return 0;
+}
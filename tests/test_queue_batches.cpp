@@ -0,0 +1,189 @@
+/*
+ * test_queue_batches.cpp
+ *
+ * queueEvents() on every kind of queue:  kAllOrNothing queues the whole batch or none of
+ * it, kAcceptPartial as many events as fit, the first ones, and either way the events are
+ * handled in order and those left out are counted as dropped.  Each case starts at every
+ * position in the ring, so batches wrap around its end.  On a MpscLockFree queue, the
+ * events of a batch queued from another thread become visible all at once.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+static const int kQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+
+static std::vector<int> gHandled;
+
+static void listener( int, int param )
+{
+    gHandled.push_back( param );
+}
+
+
+// A batch of numEvents events with parameters first, first + 1, ...
+static std::vector< EventManager::Event > batchOf( int first, int numEvents )
+{
+    std::vector< EventManager::Event > batch;
+    for ( int i = 0; i < numEvents; i++ )
+    {
+        EventManager::Event event = { EventManager::kEventUser0, first + i };
+        batch.push_back( event );
+    }
+    return batch;
+}
+
+
+template< class Manager >
+static void run( const char* name )
+{
+    for ( int start = 0; start < kQueueSize; start++ )
+    {
+        Manager* eventManager = new Manager;
+        eventManager->addListener( EventManager::kEventUser0, listener );
+
+        // Move the head and tail along to start
+        for ( int i = 0; i < start; i++ )
+        {
+            CHECK( eventManager->queueEvent( EventManager::kEventUser0, 0 ) );
+        }
+        eventManager->processAllEvents();
+        gHandled.clear();
+
+        std::vector< EventManager::Event > first = batchOf( 100, kQueueSize - 3 );
+        std::vector< EventManager::Event > second = batchOf( 200, 5 );
+        std::vector< EventManager::Event > third = batchOf( 300, 2 );
+
+        // The whole batch, by default all or nothing
+        CHECK( eventManager->queueEvents( &first[0], kQueueSize - 3 ) == kQueueSize - 3 );
+
+        // 3 slots left:  all or nothing rejects 5, accepting partial takes the first 3
+        CHECK( eventManager->queueEvents( &second[0], 5, EventManager::kLowPriority, EventManager::kAllOrNothing ) == 0 );
+        CHECK( eventManager->getNumEventsInQueue() == kQueueSize - 3 );
+        CHECK( eventManager->queueEvents( &second[0], 5, EventManager::kLowPriority, EventManager::kAcceptPartial ) == 3 );
+        CHECK( eventManager->isEventQueueFull() );
+
+        // Nothing fits now, in either mode, and empty batches queue nothing
+        CHECK( eventManager->queueEvents( &third[0], 2, EventManager::kLowPriority, EventManager::kAcceptPartial ) == 0 );
+        CHECK( eventManager->queueEvents( &third[0], 2 ) == 0 );
+        CHECK( eventManager->queueEvents( &third[0], 0, EventManager::kLowPriority, EventManager::kAcceptPartial ) == 0 );
+        CHECK( eventManager->getOverflowStats().droppedNewest == 5 + 2 + 2 + 2 );
+
+        CHECK( eventManager->processAllEvents() == kQueueSize );
+        CHECK( static_cast<int>( gHandled.size() ) == kQueueSize );
+        for ( int i = 0; i < kQueueSize - 3; i++ )
+        {
+            CHECK( gHandled[i] == 100 + i );
+        }
+        for ( int i = 0; i < 3; i++ )
+        {
+            CHECK( gHandled[ kQueueSize - 3 + i ] == 200 + i );
+        }
+
+        // A batch the size of the queue fits exactly
+        std::vector< EventManager::Event > full = batchOf( 400, kQueueSize );
+        CHECK( eventManager->queueEvents( &full[0], kQueueSize ) == kQueueSize );
+        gHandled.clear();
+        CHECK( eventManager->processAllEvents() == kQueueSize );
+        CHECK( gHandled.front() == 400 && gHandled.back() == 400 + kQueueSize - 1 );
+
+        delete eventManager;
+    }
+
+    printf( "%-30s ok\n", name );
+}
+
+
+#if EVENTMANAGER_HAS_CAS
+
+// Producers queue batches of kBatch events, numbered in order;  the consumer checks that
+// once it has the first event of a batch, the rest can be had at once
+static void mpscVisibility()
+{
+    const int kProducers = 2;
+    const int kBatch = 3;
+    const int kBatches = 2000;
+
+    typedef SizedEventManager< 16, 16, 1, EventManager::MpscLockFree > Manager;
+    Manager* eventManager = new Manager;
+    eventManager->setDefaultListener( listener );
+
+    std::atomic<int> running( kProducers );
+    std::vector<std::thread> producers;
+    for ( int p = 0; p < kProducers; p++ )
+    {
+        producers.push_back( std::thread( [ eventManager, &running, p ]
+        {
+            for ( int b = 0; b < kBatches; b++ )
+            {
+                EventManager::Event batch[ kBatch ];
+                for ( int i = 0; i < kBatch; i++ )
+                {
+                    batch[i].code = p;
+                    batch[i].param = ( p << 24 ) | ( b * kBatch + i );
+                }
+                while ( !eventManager->queueEvents( batch, kBatch ) )
+                {
+                    std::this_thread::yield();
+                }
+            }
+            running--;
+        } ) );
+    }
+
+    std::vector<int> next( kProducers, 0 );
+    int handled = 0;
+    while ( running > 0 || !eventManager->isEventQueueEmpty() )
+    {
+        gHandled.clear();
+        if ( eventManager->processEvent() == 0 )
+        {
+            continue;
+        }
+        CHECK( gHandled.size() == 1 );
+        int p = gHandled[0] >> 24;
+        int seq = gHandled[0] & 0xffffff;
+        CHECK( seq == next[p] && seq % kBatch == 0 );
+
+        // The rest of the batch follows in the very next slots, already published
+        for ( int i = 1; i < kBatch; i++ )
+        {
+            gHandled.clear();
+            CHECK( eventManager->processEvent() == 1 );
+            CHECK( gHandled.size() == 1 && gHandled[0] == ( ( p << 24 ) | ( seq + i ) ) );
+        }
+        next[p] = seq + kBatch;
+        handled += kBatch;
+    }
+    for ( size_t i = 0; i < producers.size(); i++ )
+    {
+        producers[i].join();
+    }
+    CHECK( handled == kProducers * kBatches * kBatch );
+
+    printf( "%-30s %d producers:  ok\n", "MpscLockFree visibility", kProducers );
+    delete eventManager;
+}
+
+#endif
+
+
+int main()
+{
+    run< EventManager >( "InterruptMask" );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+    run< EventManagerT< EventManager::SpscLockFree > >( "SpscLockFree" );
+#if EVENTMANAGER_HAS_CAS
+    run< EventManagerT< EventManager::MpscLockFree > >( "MpscLockFree" );
+    mpscVisibility();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * test_queue_stats.cpp
+ *
+ * Checks the queue statistics (EVENTMANAGER_QUEUE_STATS):  the high-water mark, the
+ * counts of queued and dropped events and the occupancy histogram, for every kind of
+ * queue, and that the counts stay exact with producers on several threads.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+static const int kQueueSize = EVENTMANAGER_EVENT_QUEUE_SIZE;
+
+static long gHandled;
+
+
+static void listener( int, int )
+{
+    gHandled++;
+}
+
+
+template< class Manager >
+static void run( const char* name )
+{
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+
+    for ( int i = 0; i < kQueueSize + 2; i++ )
+    {
+        eventManager->queueEvent( EventManager::kEventUser0, i );
+    }
+    EventManager::QueueStats stats = eventManager->getQueueStats();
+    CHECK( stats.highWaterMark == kQueueSize );
+    CHECK( stats.queued == static_cast<unsigned long>( kQueueSize ) && stats.dropped == 2 );
+
+    // Occupancies 1 to 8 after each event:  bin 0 holds 1, bin 1 holds 2-3, bin 2 holds 4-7, bin 3 holds 8
+    CHECK( stats.occupancy[0] == 1 && stats.occupancy[1] == 2 && stats.occupancy[2] == 4 && stats.occupancy[3] == 1 );
+
+    // A batch counts each event, but records the occupancy once
+    eventManager->processAllEvents();
+    EventManager::Event batch[3] = { { EventManager::kEventUser0, 1 }, { EventManager::kEventUser0, 2 }, { EventManager::kEventUser0, 3 } };
+    CHECK( eventManager->queueEvents( batch, 3 ) == 3 );
+    stats = eventManager->getQueueStats();
+    CHECK( stats.queued == static_cast<unsigned long>( kQueueSize + 3 ) && stats.occupancy[1] == 3 );
+
+    eventManager->resetQueueStats();
+    stats = eventManager->getQueueStats();
+    CHECK( stats.queued == 0 && stats.dropped == 0 && stats.highWaterMark == 0 && stats.occupancy[1] == 0 );
+
+    // Each queue keeps its own statistics
+    CHECK( eventManager->getQueueStats( EventManager::kHighPriority ).queued == 0 );
+
+    printf( "%-30s ok\n", name );
+    delete eventManager;
+}
+
+
+// Counts stay exact when several threads queue events at once
+template< class Manager >
+static void concurrent( const char* name )
+{
+    const int kProducers = 4;
+    const int kAttempts = 20000;
+
+    Manager* eventManager = new Manager;
+    eventManager->addListener( EventManager::kEventUser0, listener );
+    gHandled = 0;
+
+    std::atomic<long> rejected( 0 );
+    std::atomic<int> running( kProducers );
+    std::vector<std::thread> producers;
+    for ( int p = 0; p < kProducers; p++ )
+    {
+        producers.push_back( std::thread( [ eventManager, &rejected, &running ]
+        {
+            for ( int i = 0; i < kAttempts; i++ )
+            {
+                if ( !eventManager->queueEvent( EventManager::kEventUser0, i ) )
+                {
+                    rejected++;
+                }
+            }
+            running--;
+        } ) );
+    }
+    while ( running > 0 )
+    {
+        eventManager->processAllEvents();
+    }
+    for ( size_t i = 0; i < producers.size(); i++ )
+    {
+        producers[i].join();
+    }
+    eventManager->processAllEvents();
+
+    EventManager::QueueStats stats = eventManager->getQueueStats();
+    CHECK( static_cast<long>( stats.queued ) == gHandled );
+    CHECK( static_cast<long>( stats.dropped ) == rejected );
+    CHECK( gHandled + rejected == static_cast<long>( kProducers ) * kAttempts );
+
+    unsigned long histogram = 0;
+    for ( int bin = 0; bin < EventManager::kNumOccupancyBins; bin++ )
+    {
+        histogram += stats.occupancy[ bin ];
+    }
+    CHECK( static_cast<long>( histogram ) == gHandled );
+
+    printf( "%-30s %d producers:  ok\n", name, kProducers );
+    delete eventManager;
+}
+
+
+int main()
+{
+    run< EventManager >( "InterruptMask" );
+    run< EventManagerT< EventManager::PowerOfTwoRing< EventManager::InterruptMask > > >( "PowerOfTwoRing<InterruptMask>" );
+    run< EventManagerT< EventManager::SpscLockFree > >( "SpscLockFree" );
+#if EVENTMANAGER_HAS_CAS
+    run< EventManagerT< EventManager::MpscLockFree > >( "MpscLockFree" );
+#endif
+
+    // Losses under the other overflow policies count as dropped too
+    {
+        EventManager eventManager;
+        CHECK( eventManager.setOverflowPolicy( EventManager::kLowPriority, EventManager::kDropOldest ) );
+        for ( int i = 0; i < kQueueSize + 2; i++ )
+        {
+            eventManager.queueEvent( EventManager::kEventUser0, i );
+        }
+        EventManager::QueueStats stats = eventManager.getQueueStats();
+        CHECK( stats.queued == static_cast<unsigned long>( kQueueSize + 2 ) && stats.dropped == 2 );
+        printf( "%-30s ok\n", "kDropOldest" );
+    }
+
+    concurrent< EventManagerT< EventManager::SpinLock > >( "SpinLock" );
+#if EVENTMANAGER_HAS_CAS
+    concurrent< EventManagerT< EventManager::MpscLockFree > >( "MpscLockFree" );
+#endif
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * test_range_listeners.cpp
+ *
+ * Range and mask listeners:  each is called for every code it covers, merged by priority
+ * with the listeners for single codes (which come first at equal priority), and takes a
+ * single entry of the listener list.  Checked on a fixed set of listeners, then against a
+ * model with random ranges, masks and priorities.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+
+// Each listener appends its letter to the log
+static std::string gLog;
+
+static void onMenu( int eventCode, int )
+{
+    gLog += 'm';
+    gLog += static_cast<char>( '0' + ( eventCode - EventManager::kEventMenu0 ) );
+}
+
+static void onExact( int, int )
+{
+    gLog += 'e';
+}
+
+static void onMask( int, int )
+{
+    gLog += 'k';
+}
+
+static boolean onStop( int, int )
+{
+    gLog += 's';
+    return true;
+}
+
+
+// For the model:  listener number *context is called
+static std::vector<int> gCalls;
+
+static void onNumbered( void* context, int, int )
+{
+    gCalls.push_back( *static_cast<int*>( context ) );
+}
+
+struct ModelListener
+{
+    enum Kind { kCode, kRange, kMask };
+
+    int                             number;
+    Kind                            kind;
+    int                             code;       // the code, the first code or the value
+    int                             data;       // the last code or the mask
+    int                             priority;
+    EventManager::ListenerHandle    handle;
+
+    bool covers( int eventCode ) const
+    {
+        switch ( kind )
+        {
+            case kCode:     return eventCode == code;
+            case kRange:    return ( eventCode >= code ) && ( eventCode <= data );
+            default:        return ( eventCode & data ) == code;
+        }
+    }
+};
+
+// The order listeners are called in:  by decreasing priority, single codes first, then in
+// the order they were added
+static bool calledBefore( const ModelListener& a, const ModelListener& b )
+{
+    if ( a.priority != b.priority )
+    {
+        return a.priority > b.priority;
+    }
+    if ( ( a.kind == ModelListener::kCode ) != ( b.kind == ModelListener::kCode ) )
+    {
+        return a.kind == ModelListener::kCode;
+    }
+    return a.number < b.number;
+}
+
+
+static void fixed()
+{
+    SizedEventManager< 8, 16, 4 > eventManager;
+
+    CHECK( eventManager.addRangeListener( EventManager::kEventMenu0, EventManager::kEventMenu9, onMenu ) );
+    CHECK( !eventManager.addRangeListener( 5, 4, onMenu ) );
+    CHECK( eventManager.addListener( EventManager::kEventMenu3, onExact ) );
+    CHECK( eventManager.addMaskListener( 0x1003, 0xF00F, onMask, 5 ) );
+    CHECK( eventManager.numListeners() == 3 );
+
+    // A value with bits outside the mask could match no code, and is refused
+    CHECK( !eventManager.addMaskListener( 0x13, 0x0F, onMask ) );
+    CHECK( eventManager.numListeners() == 3 );
+
+    for ( int code = EventManager::kEventMenu0; code <= EventManager::kEventMenu9; code++ )
+    {
+        CHECK( eventManager.queueEvent( code, 0 ) );
+    }
+    CHECK( eventManager.queueEvent( 0x1233, 0 ) );
+    CHECK( eventManager.queueEvent( 0x1234, 0 ) );
+    CHECK( eventManager.processAllEvents() == 12 );
+    CHECK( gLog == "m0m1m2em3m4m5m6m7m8m9k" );
+
+    // A range of every code is one more entry, and a higher priority one is called before
+    // the single code listener, a lower priority one after the mask listener
+    gLog.clear();
+    CHECK( eventManager.addRangeListener( 0, 0x7FFF, onStop, 3 ) );
+    CHECK( eventManager.isListenerListFull() );
+    CHECK( eventManager.queueEvent( EventManager::kEventMenu3, 0 ) );
+    CHECK( eventManager.queueEvent( 0x1003, 0 ) );
+    CHECK( eventManager.processAllEvents() == 3 );
+    CHECK( gLog == "sks" );
+
+    // Removing the function removes the whole range
+    CHECK( eventManager.removeListener( onStop ) == 1 );
+    CHECK( eventManager.removeListener( onMenu ) == 1 );
+    gLog.clear();
+    CHECK( eventManager.queueEvent( EventManager::kEventMenu3, 0 ) );
+    CHECK( eventManager.queueEvent( 0x1003, 0 ) );
+    CHECK( eventManager.queueEvent( EventManager::kEventMenu4, 0 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( gLog == "ek" );
+    CHECK( eventManager.removeListener( EventManager::kEventMenu3, onExact ) );
+    CHECK( eventManager.numListeners() == 1 );
+
+    printf( "%-30s ok\n", "fixed listeners" );
+}
+
+
+static void model()
+{
+    const int kListeners = 16;
+    const int kCodes = 40;
+
+    static int numbers[ 1000 ];
+    for ( int i = 0; i < 1000; i++ )
+    {
+        numbers[i] = i;
+    }
+
+    srand( 1 );
+    for ( int round = 0; round < 300; round++ )
+    {
+        SizedEventManager< 4, 4, kListeners > eventManager;
+        std::vector< ModelListener > listeners;
+        int numAdded = 0;
+
+        for ( int step = 0; step < 60; step++ )
+        {
+            if ( ( rand() % 3 ) || listeners.empty() )
+            {
+                ModelListener added;
+                added.number = numAdded;
+                added.kind = static_cast< ModelListener::Kind >( rand() % 3 );
+                added.priority = rand() % 3 - 1;
+                EventManager::Delegate listener( onNumbered, &numbers[ numAdded ] );
+                switch ( added.kind )
+                {
+                    case ModelListener::kCode:
+                        added.code = rand() % kCodes;
+                        added.data = 0;
+                        added.handle = eventManager.addListener( added.code, listener, static_cast<int8_t>( added.priority ) );
+                        break;
+
+                    case ModelListener::kRange:
+                        added.code = rand() % kCodes;
+                        added.data = added.code + rand() % 8;
+                        added.handle = eventManager.addRangeListener( added.code, added.data, listener, static_cast<int8_t>( added.priority ) );
+                        break;
+
+                    default:
+                        added.data = ( rand() % 8 ) << 1 | 1;
+                        added.code = rand() & added.data;
+                        added.handle = eventManager.addMaskListener( added.code, added.data, listener, static_cast<int8_t>( added.priority ) );
+                        break;
+                }
+                CHECK( ( added.handle != 0 ) == ( listeners.size() < static_cast<size_t>( kListeners ) ) );
+                if ( added.handle )
+                {
+                    listeners.push_back( added );
+                    numAdded++;
+                }
+            }
+            else
+            {
+                size_t removed = rand() % listeners.size();
+                CHECK( eventManager.removeListener( listeners[ removed ].handle ) );
+                CHECK( !eventManager.removeListener( listeners[ removed ].handle ) );
+                listeners.erase( listeners.begin() + removed );
+            }
+
+            int eventCode = rand() % ( kCodes + 8 );
+            std::vector< ModelListener > covering;
+            for ( size_t i = 0; i < listeners.size(); i++ )
+            {
+                if ( listeners[i].covers( eventCode ) )
+                {
+                    covering.push_back( listeners[i] );
+                }
+            }
+            std::sort( covering.begin(), covering.end(), calledBefore );
+            std::vector<int> expected;
+            for ( size_t i = 0; i < covering.size(); i++ )
+            {
+                expected.push_back( covering[i].number );
+            }
+
+            gCalls.clear();
+            CHECK( eventManager.queueEvent( eventCode, 0 ) );
+            CHECK( eventManager.processEvent() == static_cast<int>( expected.size() ) );
+            CHECK( gCalls == expected );
+            CHECK( eventManager.numListeners() == static_cast<int>( listeners.size() ) );
+        }
+    }
+
+    printf( "%-30s ok\n", "random ranges and masks" );
+}
+
+
+int main()
+{
+    fixed();
+    model();
+    return 0;
+}
@@ -0,0 +1,262 @@
+/*
+ * test_reentrant_listeners.cpp
+ *
+ * Listeners that add and remove listeners while an event is being dispatched, directly
+ * and from nested dispatches:  a listener removed during the dispatch is not called
+ * after that, and one added is not called until the next event, once the outermost
+ * dispatch is done.  Checked on fixed cases, then with random changes from inside
+ * listeners against a model of the listener list.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <stdlib.h>
+
+#include <iterator>
+#include <map>
+#include <string>
+#include <utility>
+
+
+typedef SizedEventManager< 8, 16, 6 > Manager;
+
+static Manager* gEventManager;
+static EventManager::ListenerHandle gOnce;
+static EventManager::ListenerHandle gB;
+
+// Each listener appends its letter to the log
+static std::string gLog;
+
+static void onAdded( int, int )
+{
+    gLog += 'n';
+}
+
+// Removes itself
+static void onOnce( int, int )
+{
+    gLog += 'o';
+    CHECK( gEventManager->removeListener( gOnce ) );
+}
+
+// Removes b, which has not been called yet, and adds a listener for this event
+static void onA( int, int )
+{
+    gLog += 'a';
+    CHECK( gEventManager->removeListener( gB ) );
+    CHECK( gEventManager->addListener( 1, onAdded, 20 ) );
+}
+
+static void onB( int, int )
+{
+    gLog += 'b';
+}
+
+static void onC( int, int )
+{
+    gLog += 'c';
+}
+
+// Handles an event of its own in the middle of this one
+static void onNest( int, int )
+{
+    gLog += 'x';
+    CHECK( gEventManager->queueEvent( 2, 0 ) );
+    gEventManager->processEvent();
+    gLog += 'X';
+}
+
+static void onTwo( int, int )
+{
+    gLog += '2';
+    CHECK( gEventManager->addListener( 3, onB ) );
+    CHECK( gEventManager->removeListener( onC ) == 1 );
+}
+
+// Tries to replace b with c in a full list
+static SizedEventManager< 4, 4, 2 >* gFullManager;
+
+static void onReplace( int, int )
+{
+    gLog += 'r';
+    CHECK( gFullManager->removeListener( onB ) == 1 );
+    CHECK( !gFullManager->isListenerListFull() );
+    CHECK( !gFullManager->addListener( 1, onC ) );
+}
+
+
+static void fixed()
+{
+    Manager eventManager;
+    gEventManager = &eventManager;
+
+    gOnce = eventManager.addListener( 1, onOnce, 10 );
+    CHECK( eventManager.addListener( 1, onA, 5 ) );
+    gB = eventManager.addListener( 1, onB, 1 );
+    CHECK( eventManager.addListener( 1, onC ) );
+
+    // o removes itself and a removes b:  neither runs again, and the listener a adds, though
+    // its priority is the highest, waits for the next event
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.processEvent() == 3 );
+    CHECK( gLog == "oac" );
+    CHECK( eventManager.numListeners() == 3 );
+
+    gLog.clear();
+    CHECK( eventManager.removeListener( onA ) == 1 );
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.processEvent() == 2 );
+    CHECK( gLog == "nc" );
+
+    // Changes from a nested dispatch:  the removal takes effect at once, the listener
+    // added waits for the outermost dispatch to finish
+    gLog.clear();
+    CHECK( eventManager.addListener( 4, onNest ) );
+    CHECK( eventManager.addListener( 2, onTwo ) );
+    CHECK( eventManager.queueEvent( 4, 0 ) );
+    eventManager.processEvent();
+    CHECK( gLog == "x2X" );
+    CHECK( eventManager.numListeners() == 4 );
+
+    gLog.clear();
+    CHECK( eventManager.queueEvent( 3, 0 ) );
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.processAllEvents() == 2 );
+    CHECK( gLog == "bn" );
+
+    printf( "%-30s ok\n", "fixed changes" );
+}
+
+
+static void full()
+{
+    SizedEventManager< 4, 4, 2 > eventManager;
+    gFullManager = &eventManager;
+
+    // A removed listener's slot cannot be reused until the dispatch is done
+    CHECK( eventManager.addListener( 1, onReplace ) );
+    CHECK( eventManager.addListener( 1, onB ) );
+    gLog.clear();
+    CHECK( eventManager.queueEvent( 1, 0 ) );
+    CHECK( eventManager.processEvent() == 1 );
+    CHECK( gLog == "r" );
+
+    // Once it is done, it can
+    CHECK( eventManager.addListener( 1, onC ) );
+    CHECK( eventManager.isListenerListFull() );
+
+    printf( "%-30s ok\n", "full list" );
+}
+
+
+// The model:  the first and last codes of each live listener, by handle
+typedef SizedEventManager< 8, 64, 12 > FuzzManager;
+
+static FuzzManager* gFuzzManager;
+static std::map< EventManager::ListenerHandle, std::pair< int, int > > gLive;
+static long gCalls;
+static bool gFrozen;
+
+static void onFuzz( int, int );
+
+// Adds a range or single code listener, or removes one, at random
+static void change()
+{
+    int op = rand() % 3;
+    if ( op < 2 )
+    {
+        int first = rand() % 5;
+        int last = ( op == 0 ) ? 4 : first;
+        int8_t priority = static_cast<int8_t>( rand() % 3 );
+        EventManager::ListenerHandle handle = ( op == 0 ) ? gFuzzManager->addRangeListener( first, last, onFuzz, priority )
+                                                          : gFuzzManager->addListener( first, onFuzz, priority );
+        if ( handle )
+        {
+            CHECK( gLive.count( handle ) == 0 );
+            gLive[ handle ] = std::make_pair( first, last );
+        }
+    }
+    else if ( !gLive.empty() )
+    {
+        std::map< EventManager::ListenerHandle, std::pair< int, int > >::iterator it = gLive.begin();
+        std::advance( it, rand() % gLive.size() );
+        CHECK( gFuzzManager->removeListener( it->first ) );
+        CHECK( !gFuzzManager->removeListener( it->first ) );
+        gLive.erase( it );
+    }
+}
+
+static void onFuzz( int, int )
+{
+    gCalls++;
+    if ( gFrozen )
+    {
+        return;
+    }
+    if ( rand() % 2 )
+    {
+        change();
+    }
+    if ( rand() % 20 == 0 )
+    {
+        CHECK( gFuzzManager->queueEvent( rand() % 5, 0 ) );
+        gFuzzManager->processEvent();
+    }
+}
+
+
+static void fuzz()
+{
+    FuzzManager* eventManager = new FuzzManager;
+    gFuzzManager = eventManager;
+
+    srand( 7 );
+    for ( int step = 0; step < 200000; step++ )
+    {
+        if ( rand() % 3 == 0 )
+        {
+            change();
+        }
+        CHECK( eventManager->queueEvent( rand() % 5, 0 ) );
+        eventManager->processEvent();
+        CHECK( eventManager->numListeners() == static_cast<int>( gLive.size() ) );
+
+        // Between events, every live listener is in place:  with no changes, an event
+        // reaches exactly the listeners that cover its code
+        if ( step % 100 == 0 )
+        {
+            gFrozen = true;
+            for ( int code = 0; code < 5; code++ )
+            {
+                int expected = 0;
+                std::map< EventManager::ListenerHandle, std::pair< int, int > >::iterator it;
+                for ( it = gLive.begin(); it != gLive.end(); ++it )
+                {
+                    CHECK( eventManager->isListenerEnabled( it->first ) );
+                    if ( ( code >= it->second.first ) && ( code <= it->second.second ) )
+                    {
+                        expected++;
+                    }
+                }
+                CHECK( eventManager->queueEvent( code, 0 ) );
+                CHECK( eventManager->processEvent() == expected );
+            }
+            gFrozen = false;
+        }
+    }
+
+    printf( "%-30s ok:  %ld calls\n", "random changes", gCalls );
+    delete eventManager;
+}
+
+
+int main()
+{
+    fixed();
+    full();
+    fuzz();
+    return 0;
+}
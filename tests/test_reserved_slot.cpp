@@ -0,0 +1,100 @@
+/*
+ * test_reserved_slot.cpp
+ *
+ * A producer on an MpscLockFree queue first reserves the slot at the tail and only
+ * then fills it in and publishes it.  If it is preempted in between, the queue is
+ * not empty but its head event cannot be popped yet.  processEvent() and
+ * processAllEvents() must then return, and still handle the events waiting at lower
+ * priority levels, instead of spinning on the reserved slot.
+ *
+ * A reservation is held open by advancing the queue's enqueue position by hand,
+ * which needs access to the queue's internals.
+ *
+ */
+
+
+// The standard headers first, so only the library's classes are opened up
+#include <mutex>
+#include <signal.h>
+#include <unistd.h>
+
+#define private public
+#define protected public
+#include "EventManager.h"
+#undef private
+#undef protected
+
+#include "TestCheck.h"
+
+
+typedef SizedEventManager< 8, 8, 1, EventManager::MpscLockFree > MpscEventManager;
+
+static MpscEventManager gEventManager;
+
+static int gLastParam;
+static int gHandled;
+
+
+static void listener( int, int param )
+{
+    gLastParam = param;
+    gHandled++;
+}
+
+
+// Reserve the next slot of the high priority queue as a producer would, without publishing it
+static unsigned int reserveHighPrioritySlot()
+{
+    unsigned int pos = __atomic_fetch_add( &gEventManager.mHighPriorityQueue.mEnqueuePos, 1, __ATOMIC_RELAXED );
+    gEventManager.mReadyLevels.set( 0 );
+    return pos;
+}
+
+
+// Fill in and publish a slot reserved by reserveHighPrioritySlot()
+static void publishHighPrioritySlot( unsigned int pos, int param )
+{
+    EventManager::EventQueue< 8, EventManager::MpscLockFree >::Slot& slot = gEventManager.mHighPriorityQueue.mEventQueue[ pos & ( 8 - 1 ) ];
+    slot.event.code = EventManager::kEventUser0;
+    slot.event.param = param;
+    __atomic_store_n( &slot.sequence, pos + 1, __ATOMIC_RELEASE );
+}
+
+
+int main()
+{
+    // A regression would spin forever:  fail instead
+    alarm( 10 );
+
+    gEventManager.addListener( EventManager::kEventUser0, listener );
+
+    // Nothing but the reservation:  processing returns without handling anything
+    unsigned int pos = reserveHighPrioritySlot();
+    CHECK( !gEventManager.isEventQueueEmpty( EventManager::kHighPriority ) );
+    CHECK( gEventManager.processEvent() == 0 );
+    CHECK( gEventManager.processAllEvents() == 0 );
+    CHECK( gHandled == 0 );
+
+    // Events at the lower level are handled while the high priority slot is still reserved
+    CHECK( gEventManager.queueEvent( EventManager::kEventUser0, 1, EventManager::kLowPriority ) );
+    CHECK( gEventManager.processEvent() == 1 );
+    CHECK( gLastParam == 1 );
+    CHECK( gEventManager.queueEvent( EventManager::kEventUser0, 2, EventManager::kLowPriority ) );
+    CHECK( gEventManager.queueEvent( EventManager::kEventUser0, 3, EventManager::kLowPriority ) );
+    CHECK( gEventManager.processAllEvents() == 2 );
+    CHECK( gLastParam == 3 );
+
+    // Once the producer publishes its event, it is handled ahead of the lower level
+    CHECK( gEventManager.queueEvent( EventManager::kEventUser0, 4, EventManager::kLowPriority ) );
+    publishHighPrioritySlot( pos, 100 );
+    CHECK( gEventManager.processEvent() == 1 );
+    CHECK( gLastParam == 100 );
+    CHECK( gEventManager.processEvent() == 1 );
+    CHECK( gLastParam == 4 );
+
+    CHECK( gEventManager.isEventQueueEmpty( EventManager::kHighPriority ) );
+    CHECK( gEventManager.isEventQueueEmpty( EventManager::kLowPriority ) );
+    CHECK( gHandled == 5 );
+
+    return 0;
+}
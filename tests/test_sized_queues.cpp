@@ -0,0 +1,102 @@
+/*
+ * test_sized_queues.cpp
+ *
+ * SizedEventManager with different high and low priority capacities:  each queue holds
+ * exactly its own number of events, rejects the next one without touching the other
+ * queue, and takes events again once processing has made room.  Checked on each kind of
+ * queue, including a manager with a middle priority level, which has the low capacity.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+
+static int gHandled;
+
+static void listener( int, int )
+{
+    gHandled++;
+}
+
+
+// Fills the queue for pri up to size events, then checks it refuses one more
+template< class Manager >
+static void fill( Manager* eventManager, EventManager::EventPriority pri, int size )
+{
+    for ( int i = 0; i < size; i++ )
+    {
+        CHECK( !eventManager->isEventQueueFull( pri ) );
+        CHECK( eventManager->queueEvent( EventManager::kEventUser0, i, pri ) );
+    }
+    CHECK( eventManager->isEventQueueFull( pri ) );
+    CHECK( eventManager->getNumEventsInQueue( pri ) == size );
+    CHECK( !eventManager->queueEvent( EventManager::kEventUser0, size, pri ) );
+    CHECK( eventManager->getNumEventsInQueue( pri ) == size );
+}
+
+
+template< class Manager, int HiSize, int LoSize, int Levels >
+static void run( const char* name )
+{
+    Manager* eventManager = new Manager;
+    eventManager->setDefaultListener( listener );
+
+    // Each queue fills to its own size, however full the others are
+    fill( eventManager, EventManager::kHighPriority, HiSize );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kLowPriority ) );
+    fill( eventManager, EventManager::kLowPriority, LoSize );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kHighPriority ) == HiSize );
+    int total = HiSize + LoSize;
+    if ( Levels > 2 )
+    {
+        // Levels below the highest have the low priority capacity
+        fill( eventManager, static_cast<EventManager::EventPriority>( 1 ), LoSize );
+        total += LoSize;
+    }
+    CHECK( eventManager->getOverflowStats( EventManager::kHighPriority ).droppedNewest == 1 );
+    CHECK( eventManager->getOverflowStats( EventManager::kLowPriority ).droppedNewest == 1 );
+
+    // Room again after one event of each queue has been handled:  the high one first
+    gHandled = 0;
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kHighPriority ) == HiSize - 1 );
+    CHECK( eventManager->getNumEventsInQueue( EventManager::kLowPriority ) == LoSize );
+    CHECK( eventManager->queueEvent( EventManager::kEventUser0, 0, EventManager::kHighPriority ) );
+    CHECK( !eventManager->queueEvent( EventManager::kEventUser0, 0, EventManager::kLowPriority ) );
+
+    CHECK( eventManager->processAllEvents() == total );
+    CHECK( gHandled == total + 1 );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kHighPriority ) );
+    CHECK( eventManager->isEventQueueEmpty( EventManager::kLowPriority ) );
+
+    // And once more from where the first round left the indexes, low priority first this time
+    fill( eventManager, EventManager::kLowPriority, LoSize );
+    fill( eventManager, EventManager::kHighPriority, HiSize );
+
+    delete eventManager;
+    printf( "%-30s %d/%d:  ok\n", name, HiSize, LoSize );
+}
+
+
+int main()
+{
+    // Any sizes for the queues that count their events
+    run< SizedEventManager< 3, 11, 1 >, 3, 11, 2 >( "InterruptMask" );
+    run< SizedEventManager< 11, 3, 1 >, 11, 3, 2 >( "InterruptMask" );
+    run< SizedEventManager< 3, 11, 1, EventManager::SpscLockFree >, 3, 11, 2 >( "SpscLockFree" );
+    run< SizedEventManager< 11, 3, 1, EventManager::SpscLockFree >, 11, 3, 2 >( "SpscLockFree" );
+    run< SizedEventManager< 3, 11, 1, EventManager::DefaultLockPolicy, 3 >, 3, 11, 3 >( "InterruptMask, 3 levels" );
+
+    // Powers of two for the others
+    run< SizedEventManager< 4, 16, 1, EventManager::PowerOfTwoRing< EventManager::InterruptMask > >, 4, 16, 2 >( "PowerOfTwoRing<InterruptMask>" );
+    run< SizedEventManager< 16, 4, 1, EventManager::PowerOfTwoRing< EventManager::InterruptMask > >, 16, 4, 2 >( "PowerOfTwoRing<InterruptMask>" );
+#if EVENTMANAGER_HAS_CAS
+    run< SizedEventManager< 4, 16, 1, EventManager::MpscLockFree >, 4, 16, 2 >( "MpscLockFree" );
+    run< SizedEventManager< 16, 4, 1, EventManager::MpscLockFree >, 16, 4, 2 >( "MpscLockFree" );
+    run< SizedEventManager< 4, 16, 1, EventManager::MpscLockFree, 3 >, 4, 16, 3 >( "MpscLockFree, 3 levels" );
+#endif
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * test_spsc_stress.cpp
+ *
+ * Drives an SpscLockFree queue from a signal handler, the host's stand-in for an
+ * interrupt, while the main program processes events as loop() would.  Every event
+ * queued must be handled exactly once and in order, and every event that could not
+ * be queued must have been counted as dropped.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <signal.h>
+#include <sys/time.h>
+
+
+typedef EventManagerT< EventManagerBase::SpscLockFree > SpscEventManager;
+
+static SpscEventManager gEventManager;
+
+static volatile sig_atomic_t gProduced = 0;
+static volatile sig_atomic_t gDropped = 0;
+static int gHandled = 0;
+
+
+// The "interrupt handler":  queues a short burst of numbered events
+static void onTimer( int )
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( gEventManager.queueEvent( EventManager::kEventUser0, gProduced ) )
+        {
+            gProduced = gProduced + 1;
+        }
+        else
+        {
+            gDropped = gDropped + 1;
+        }
+    }
+}
+
+
+static void listener( int, int param )
+{
+    CHECK( param == gHandled );
+    gHandled++;
+}
+
+
+int main()
+{
+    gEventManager.addListener( EventManager::kEventUser0, listener );
+
+    signal( SIGALRM, onTimer );
+    itimerval timer = { { 0, 50 }, { 0, 50 } };
+    setitimer( ITIMER_REAL, &timer, 0 );
+
+    unsigned long start = millis();
+    while ( millis() - start < 1000 )
+    {
+        gEventManager.processEvent();
+    }
+
+    itimerval stop = { { 0, 0 }, { 0, 0 } };
+    setitimer( ITIMER_REAL, &stop, 0 );
+    gEventManager.processAllEvents();
+
+    printf( "produced %d, dropped %d, handled %d\n", (int) gProduced, (int) gDropped, gHandled );
+
+    CHECK( gProduced > 1000 );
+    CHECK( gHandled == gProduced );
+    CHECK( gEventManager.getOverflowStats().droppedNewest == static_cast<unsigned int>( gDropped ) );
+    CHECK( gEventManager.isEventQueueEmpty() );
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * test_static_dispatch.cpp
+ *
+ * Processes events with a StaticDispatcher:  its listeners are called in the order
+ * they are listed, before the listeners added with addListener(), and the default
+ * listener only when neither has one.  A manager with no room for listeners at all
+ * works with a StaticDispatcher alone.
+ *
+ */
+
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+#include <string>
+
+
+// Each listener appends its letter (and for onKey, its parameter) to the log
+static std::string gLog;
+
+static void onKey( int, int param )
+{
+    gLog += 'k';
+    gLog += static_cast<char>( '0' + param );
+}
+
+static void onPaint( int, int )
+{
+    gLog += 'p';
+}
+
+static void onAdded( int, int )
+{
+    gLog += 'a';
+}
+
+static void onDefault( int, int )
+{
+    gLog += 'd';
+}
+
+
+typedef EventManager::StaticDispatcher<
+    EventManager::On< EventManager::kEventKeyPress, onKey >,
+    EventManager::On< EventManager::kEventPaint, onPaint >,
+    EventManager::On< EventManager::kEventKeyPress, onPaint > > Dispatcher;
+
+
+int main()
+{
+    {
+        EventManager eventManager;
+        eventManager.addListener( EventManager::kEventPaint, onAdded );
+        eventManager.addListener( EventManager::kEventKeyPress, onAdded );
+        eventManager.setDefaultListener( onDefault );
+
+        CHECK( eventManager.queueEvent( EventManager::kEventKeyPress, 5 ) );
+        CHECK( eventManager.queueEvent( EventManager::kEventPaint, 0 ) );
+        CHECK( eventManager.queueEvent( EventManager::kEventUser0, 0 ) );
+
+        // Both static listeners for the key, in order, then the added one
+        CHECK( eventManager.processEvent< Dispatcher >() == 3 );
+        CHECK( gLog == "k5pa" );
+
+        gLog.clear();
+        CHECK( eventManager.processAllEvents< Dispatcher >() == 3 );
+        CHECK( gLog == "pad" );
+
+        // Without the dispatcher, only the added listeners
+        gLog.clear();
+        CHECK( eventManager.queueEvent( EventManager::kEventKeyPress, 1 ) );
+        CHECK( eventManager.processEvent() == 1 );
+        CHECK( gLog == "a" );
+    }
+
+    // No listener storage at all
+    {
+        SizedEventManager< 4, 4, 0 > eventManager;
+        CHECK( eventManager.addListener( EventManager::kEventKeyPress, onAdded ) == 0 );
+        CHECK( eventManager.numListeners() == 0 );
+
+        gLog.clear();
+        CHECK( eventManager.queueEvent( EventManager::kEventKeyPress, 7 ) );
+        CHECK( eventManager.queueEvent( EventManager::kEventUser0, 0 ) );
+        CHECK( eventManager.processAllEvents< Dispatcher >() == 2 );
+        CHECK( gLog == "k7p" );
+
+        // The listener storage takes no room
+        CHECK( sizeof( SizedEventManager< 4, 4, 0 > ) < sizeof( SizedEventManager< 4, 4, 1 > ) );
+    }
+
+    printf( "static dispatch ok\n" );
+    return 0;
+}
@@ -0,0 +1,329 @@
+/*
+ * test_timers.cpp
+ *
+ * Runs the timer service on a clock the test controls.  Random starts, cancels and
+ * clock steps are checked against a simple model of the timers, then the corner
+ * cases are checked one by one:  timers due exactly at the boundaries between the
+ * levels of the wheel, the clock wrapping around, handles of reused timers, a full
+ * event queue, periodic timers that fall behind, and long gaps between calls.
+ *
+ */
+
+
+#include <time.h>
+
+#include <map>
+
+// The clock the timers count, advanced by the test
+static unsigned long gClock;
+#define EVENTMANAGER_TIMER_CLOCK()      gClock
+
+#include "EventManager.h"
+#include "TestCheck.h"
+
+
+static const int kNumTimers = EVENTMANAGER_TIMER_LIST_SIZE;
+
+// Number of events handled for each event parameter since the last clear()
+static std::map< int, int > gFired;
+
+
+static void listener( int, int param )
+{
+    gFired[ param ]++;
+}
+
+
+// The model:  when each running timer is due next, and its period
+struct ModelTimer
+{
+    unsigned long               expires;
+    unsigned long               period;
+    EventManager::TimerHandle   handle;
+};
+
+
+static void randomOperations( unsigned long startClock )
+{
+    EventManager* eventManager = new EventManager;
+    eventManager->setDefaultListener( listener );
+
+    gClock = startClock;
+    srand( 7 );
+
+    std::map< int, ModelTimer > model;
+    int nextId = 1;
+
+    for ( int step = 0; step < 100000; step++ )
+    {
+        int op = rand() % 10;
+        if ( op < 3 && static_cast<int>( model.size() ) < kNumTimers )
+        {
+            // Mostly short delays, some long enough to reach the higher levels of the wheel
+            int r = rand() % 10;
+            unsigned long delay = ( r < 5 ) ? rand() % 40 : ( r < 8 ) ? rand() % 5000 : ( r < 9 ) ? rand() % 300000 : static_cast<unsigned long>( rand() % 4000 ) * ( rand() % 4000 );
+            boolean periodic = ( rand() % 4 == 0 ) && delay >= 20;
+
+            int id = nextId++;
+            ModelTimer timer = { gClock + delay, periodic ? delay : 0, 0 };
+            timer.handle = periodic ?
+                eventManager->startPeriodicTimer( delay, EventManager::kEventUser0, id ) :
+                eventManager->startTimer( delay, EventManager::kEventUser0, id );
+            CHECK( timer.handle != 0 );
+            model[ id ] = timer;
+        }
+        else if ( op < 4 && !model.empty() )
+        {
+            std::map< int, ModelTimer >::iterator i = model.begin();
+            std::advance( i, rand() % model.size() );
+            CHECK( eventManager->isTimerRunning( i->second.handle ) );
+            CHECK( eventManager->cancelTimer( i->second.handle ) );
+            CHECK( !eventManager->cancelTimer( i->second.handle ) );
+            model.erase( i );
+        }
+        else
+        {
+            // Mostly small steps, and now and then one longer than many periods
+            int r = rand() % 100;
+            gClock += ( r < 60 ) ? rand() % 3 : ( r < 99 ) ? rand() % 50 : rand() % 5000;
+
+            gFired.clear();
+            eventManager->processAllEvents();
+
+            // Each timer that is due goes off once, however many of its periods have passed
+            std::map< int, int > expected;
+            for ( std::map< int, ModelTimer >::iterator i = model.begin(); i != model.end(); )
+            {
+                ModelTimer& timer = i->second;
+                if ( static_cast<long>( gClock - timer.expires ) < 0 )
+                {
+                    ++i;
+                    continue;
+                }
+
+                expected[ i->first ] = 1;
+                if ( timer.period )
+                {
+                    timer.expires += ( ( gClock - timer.expires ) / timer.period + 1 ) * timer.period;
+                    ++i;
+                }
+                else
+                {
+                    CHECK( !eventManager->isTimerRunning( timer.handle ) );
+                    model.erase( i++ );
+                }
+            }
+            CHECK( gFired == expected );
+        }
+    }
+
+    CHECK( eventManager->getTimerStats().deferred == 0 );
+    delete eventManager;
+}
+
+
+// A timer due exactly delay ticks from a clock that is just before a multiple of the span
+// of a wheel slot must go off on its tick, not one early or late, when the clock advances
+// one tick at a time
+static void levelBoundaries()
+{
+    static const unsigned long kDelays[] = { 1, 15, 16, 17, 255, 256, 257, 4095, 4096, 4097, 65535, 65536, 65537, 1048577 };
+    static const unsigned long kStarts[] = { 0, 1, 15, 240, 4095, 65520 };
+    const int kNumDelays = sizeof( kDelays ) / sizeof( kDelays[0] );
+
+    for ( unsigned int s = 0; s < sizeof( kStarts ) / sizeof( kStarts[0] ); s++ )
+    {
+        EventManager* eventManager = new EventManager;
+        eventManager->setDefaultListener( listener );
+        gClock = kStarts[s];
+        gFired.clear();
+
+        for ( int d = 0; d < kNumDelays; d++ )
+        {
+            CHECK( eventManager->startTimer( kDelays[d], EventManager::kEventUser0, d ) != 0 );
+        }
+
+        unsigned long end = kStarts[s] + kDelays[ kNumDelays - 1 ];
+        int next = 0;
+        while ( gClock != end )
+        {
+            gClock++;
+            eventManager->processAllEvents();
+            while ( next < kNumDelays && kStarts[s] + kDelays[ next ] == gClock )
+            {
+                CHECK( gFired[ next ] == 1 );
+                next++;
+            }
+            CHECK( static_cast<int>( gFired.size() ) == next );
+        }
+        CHECK( next == kNumDelays );
+
+        delete eventManager;
+    }
+}
+
+
+// A stopped timer's handle must not match the timer that reuses its slot
+static void handleReuse()
+{
+    EventManager* eventManager = new EventManager;
+    gClock = 1000;
+
+    EventManager::TimerHandle handles[ kNumTimers ];
+    for ( int i = 0; i < kNumTimers; i++ )
+    {
+        handles[i] = eventManager->startTimer( 100, EventManager::kEventUser0 );
+        CHECK( handles[i] != 0 );
+    }
+    CHECK( eventManager->startTimer( 100, EventManager::kEventUser0 ) == 0 );
+    CHECK( eventManager->startPeriodicTimer( 0, EventManager::kEventUser0 ) == 0 );
+
+    // Cancel one, and start another in its place
+    CHECK( eventManager->cancelTimer( handles[3] ) );
+    EventManager::TimerHandle reused = eventManager->startTimer( 100, EventManager::kEventUser0 );
+    CHECK( reused != 0 && reused != handles[3] );
+    CHECK( !eventManager->isTimerRunning( handles[3] ) );
+    CHECK( !eventManager->cancelTimer( handles[3] ) );
+    CHECK( eventManager->isTimerRunning( reused ) );
+
+    // The same after it goes off
+    gClock += 100;
+    eventManager->processAllEvents();
+    CHECK( !eventManager->isTimerRunning( reused ) );
+    EventManager::TimerHandle again = eventManager->startTimer( 100, EventManager::kEventUser0 );
+    CHECK( again != 0 && again != reused );
+    CHECK( !eventManager->cancelTimer( reused ) );
+
+    // Handles that were never issued
+    CHECK( !eventManager->isTimerRunning( 0 ) );
+    CHECK( !eventManager->isTimerRunning( kNumTimers + 1 ) );
+
+    delete eventManager;
+}
+
+
+// Timer events that find their queue full are queued by a later call rather than lost
+static void fullQueue()
+{
+    SizedEventManager< 4, 4, 4 >* eventManager = new SizedEventManager< 4, 4, 4 >;
+    eventManager->setDefaultListener( listener );
+    gClock = 0;
+    gFired.clear();
+
+    for ( int i = 0; i < 6; i++ )
+    {
+        CHECK( eventManager->startTimer( 10, EventManager::kEventUser0, i ) != 0 );
+    }
+
+    gClock = 10;
+    CHECK( eventManager->processEvent() == 1 );
+    CHECK( eventManager->getTimerStats().deferred == 1 );
+    CHECK( eventManager->getNumEventsInQueue() == 3 );
+
+    // Each call makes room for one more
+    int handled = 1;
+    while ( eventManager->processEvent() )
+    {
+        handled++;
+    }
+    CHECK( handled == 6 );
+    for ( int i = 0; i < 6; i++ )
+    {
+        CHECK( gFired[i] == 1 );
+    }
+    CHECK( eventManager->getTimerStats().deferred == 2 );
+
+    eventManager->resetTimerStats();
+    CHECK( eventManager->getTimerStats().deferred == 0 );
+    delete eventManager;
+}
+
+
+// A periodic timer that falls behind queues one event, then keeps its original phase
+static void catchUp()
+{
+    EventManager* eventManager = new EventManager;
+    eventManager->setDefaultListener( listener );
+    gClock = 0;
+    gFired.clear();
+
+    EventManager::TimerHandle handle = eventManager->startPeriodicTimer( 10, EventManager::kEventUser0, 1 );
+
+    gClock = 95;
+    eventManager->processAllEvents();
+    CHECK( gFired[1] == 1 );
+    CHECK( eventManager->getTimerStats().skipped == 8 );
+
+    gClock = 99;
+    eventManager->processAllEvents();
+    CHECK( gFired[1] == 1 );
+
+    gClock = 100;
+    eventManager->processAllEvents();
+    CHECK( gFired[1] == 2 );
+    CHECK( eventManager->getTimerStats().skipped == 8 );
+    CHECK( eventManager->isTimerRunning( handle ) );
+
+    delete eventManager;
+}
+
+
+// Processing after a gap of millions of ticks goes straight to the timers that are due,
+// rather than through every tick in between
+static void longGaps()
+{
+    EventManager* eventManager = new EventManager;
+    eventManager->setDefaultListener( listener );
+    gClock = 5;
+    gFired.clear();
+
+    // Parked on the higher levels throughout
+    EventManager::TimerHandle parked = eventManager->startTimer( 0x70000000UL, EventManager::kEventUser0, 1 );
+
+    clock_t started = clock();
+    for ( int i = 0; i < 1000; i++ )
+    {
+        unsigned long delay = ( 1UL << 20 ) + i * 997UL;
+        EventManager::TimerHandle handle = eventManager->startTimer( delay, EventManager::kEventUser0, 2 );
+        unsigned long due = gClock + delay;
+
+        gClock = due - 1;
+        eventManager->processAllEvents();
+        CHECK( gFired[2] == i );
+        CHECK( eventManager->isTimerRunning( handle ) );
+
+        gClock = due;
+        eventManager->processAllEvents();
+        CHECK( gFired[2] == i + 1 );
+        CHECK( !eventManager->isTimerRunning( handle ) );
+    }
+
+    // Ticking through the 1000 gaps one at a time would take seconds
+    CHECK( clock() - started < CLOCKS_PER_SEC );
+    CHECK( gFired[1] == 0 );
+    CHECK( eventManager->isTimerRunning( parked ) );
+
+    gClock = 5 + 0x70000000UL;
+    eventManager->processAllEvents();
+    CHECK( gFired[1] == 1 );
+
+    delete eventManager;
+}
+
+
+int main()
+{
+    randomOperations( 12345 );
+
+    // The clock wraps around during the run
+    randomOperations( ~0UL - 300000 );
+
+    levelBoundaries();
+    handleReuse();
+    fullQueue();
+    catchUp();
+    longGaps();
+
+    printf( "timers ok\n" );
+    return 0;
+}